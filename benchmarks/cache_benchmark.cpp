@@ -0,0 +1,82 @@
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/cache.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "fmt/core.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+constexpr size_t n_keys = 100000;   // paths in the cache
+constexpr size_t n_hits = 1000000;  // gets of cached paths
+constexpr size_t n_misses = 200000; // puts of new paths, each one evicting another
+
+// Nanoseconds per operation of `n_ops` calls to `op`
+template <typename F>
+double
+time_per_op(size_t n_ops, F op)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n_ops; i++) {
+    op(i);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / n_ops;
+}
+
+std::vector<std::string>
+make_paths(size_t n)
+{
+  std::vector<std::string> paths;
+  paths.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    paths.push_back("/dir" + std::to_string(i % 100) + "/file" + std::to_string(i));
+  }
+  return paths;
+}
+
+// Fills a full cache of paths, then measures hits and misses that evict
+template <typename Policy>
+void
+run(const std::string &name)
+{
+  common::cache<std::string, uint64_t, Policy> cache(n_keys, {}, {});
+  const std::vector<std::string> paths = make_paths(n_keys + n_misses);
+  for (size_t i = 0; i < n_keys; i++) {
+    cache.put(paths[i], i);
+  }
+
+  std::mt19937_64 rand_gen(1);
+  std::uniform_int_distribution<size_t> dist(0, n_keys - 1);
+  uint64_t value;
+  const double hit =
+      time_per_op(n_hits, [&](size_t) { cache.get(paths[dist(rand_gen)], value); });
+  const double miss =
+      time_per_op(n_misses, [&](size_t i) { cache.put(paths[n_keys + i], i); });
+
+  fmt::print("{:<12} {:>12.1f} {:>12.1f}\n", name, hit, miss);
+}
+
+} // namespace
+
+int
+main()
+{
+  fmt::print("generic cache engine with {} paths (ns per operation)\n", n_keys);
+  fmt::print("{:<12} {:>12} {:>12}\n", "policy", "get hit", "put miss");
+
+  run<common::intrusive_lru_policy<std::string, uint64_t>>("intrusive");
+  run<common::managed_policy<lru_cache_manager<std::string>>>("lru");
+  run<common::managed_policy<rnd_cache_manager<std::string>>>("rnd");
+  run<common::managed_policy<sampled_cache_manager<std::string>>>("sampled");
+  run<common::managed_policy<arc_cache_manager<std::string>>>("arc");
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "rsafefs/layers/data_cache/cache.hpp"
+#include "fmt/core.h"
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+constexpr size_t block_size = 16UL * 1024UL;                   // 16 KiB
+constexpr size_t n_files = 64;                                 // 64 files
+constexpr size_t blocks_per_file = 64;                         // 1 MiB per file
+constexpr size_t file_size = blocks_per_file * block_size;     // 64 MiB working set
+constexpr auto run_duration = std::chrono::milliseconds(1000); // per measurement
+
+int
+backend_getattr(const char *, struct stat *stbuf)
+{
+  std::memset(stbuf, 0, sizeof(struct stat));
+  stbuf->st_size = file_size;
+  return 0;
+}
+
+int
+backend_open(const char *, struct fuse_file_info *)
+{
+  return 0;
+}
+
+int
+backend_release(const char *, struct fuse_file_info *)
+{
+  return 0;
+}
+
+int
+backend_read(const char *, char *buf, size_t size, off_t offset, struct fuse_file_info *)
+{
+  if (static_cast<size_t>(offset) >= file_size) {
+    return 0;
+  }
+  const size_t n_bytes = std::min(size, file_size - offset);
+  std::memset(buf, static_cast<int>(offset & 0xff), n_bytes);
+  return static_cast<int>(n_bytes);
+}
+
+// Measures the cache hit throughput (in reads per second) of `n_threads` readers
+// issuing block sized reads at random offsets of an already cached working set
+double
+hit_throughput(data_cache::cache &cache, const std::vector<std::string> &paths,
+               size_t n_threads)
+{
+  std::atomic<bool> stop = false;
+  std::atomic<size_t> total_reads = 0;
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < n_threads; i++) {
+    threads.emplace_back([&, i]() {
+      std::mt19937 rand_gen(i);
+      std::uniform_int_distribution<size_t> file_dist(0, n_files - 1);
+      std::uniform_int_distribution<size_t> block_dist(0, blocks_per_file - 1);
+      auto buf = std::make_unique<char[]>(block_size);
+      struct fuse_file_info fi {
+      };
+      size_t reads = 0;
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        const std::string &path = paths[file_dist(rand_gen)];
+        const off_t offset = block_dist(rand_gen) * block_size;
+        cache.read(path.c_str(), buf.get(), block_size, offset, &fi);
+        reads++;
+      }
+      total_reads += reads;
+    });
+  }
+
+  std::this_thread::sleep_for(run_duration);
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return total_reads / std::chrono::duration<double>(run_duration).count();
+}
+
+double
+run(size_t n_shards, size_t n_threads)
+{
+  fuse_operations operations;
+  std::memset(&operations, 0, sizeof(operations));
+  operations.getattr = backend_getattr;
+  operations.open = backend_open;
+  operations.release = backend_release;
+  operations.read = backend_read;
+
+  data_cache::cache::config config;
+  config.size_ = 2 * n_files * file_size; // everything fits, only hits are measured
+  config.block_size_ = block_size;
+  config.shards_ = n_shards;
+  config.max_fetch_blocks_ = blocks_per_file;
+  config.hugepages_ = false;
+  config.time_out_ = 0;
+  config.attr_time_out_ = 0;
+  config.disk_directory_ = "";
+  config.disk_size_ = 0;
+  config.stale_while_revalidate_ = false;
+  config.refresh_workers_ = 0;
+  config.high_watermark_ = 1.0;
+  config.low_watermark_ = 1.0;
+  config.warm_start_manifest_ = "";
+  config.warm_start_rate_ = 1;
+  config.eviction_policy_ = data_cache::cache::eviction_policy::lru;
+  config.tinylfu_admission_ = false;
+
+  data_cache::cache cache(config, operations);
+
+  std::vector<std::string> paths;
+  struct fuse_file_info fi {
+  };
+  auto buf = std::make_unique<char[]>(file_size);
+  for (size_t i = 0; i < n_files; i++) {
+    paths.push_back(fmt::format("/file_{}", i));
+    cache.open(paths.back().c_str(), &fi);
+    cache.read(paths.back().c_str(), buf.get(), file_size, 0, &fi);
+  }
+
+  return hit_throughput(cache, paths, n_threads);
+}
+
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  const size_t n_shards = argc > 1 ? std::stoul(argv[1]) : 16;
+  const size_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+
+  fmt::print("data cache hit throughput (reads of {} bytes, Mreads/s)\n", block_size);
+  fmt::print("{:>8} {:>12} {:>12}\n", "threads", "1 shard",
+             fmt::format("{} shards", n_shards));
+
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+    const double single = run(1, n_threads) / 1e6;
+    const double sharded = run(n_shards, n_threads) / 1e6;
+    fmt::print("{:>8} {:>12.3f} {:>12.3f}\n", n_threads, single, sharded);
+  }
+
+  return 0;
+}
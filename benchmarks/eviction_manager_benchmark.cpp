@@ -0,0 +1,144 @@
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/intrusive_lru.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "fmt/core.h"
+#include <absl/container/flat_hash_set.h>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+constexpr size_t small_cache = 10000;   // keys of a small cache
+constexpr size_t large_cache = 1000000; // keys of a large cache
+constexpr size_t n_replacements = 2000; // evictions followed by an insert
+constexpr size_t n_hits = 1000000;      // touches of cached keys
+
+// The random manager as it was before, it walks the set up to the key to evict
+template <typename T> class linear_rnd_cache_manager : public cache_manager<T>
+{
+public:
+  linear_rnd_cache_manager()
+      : rand_gen_(std::random_device{}())
+  {
+  }
+
+  void touch(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    keys_.insert(t);
+  }
+
+  void remove(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    keys_.erase(t);
+  }
+
+  std::optional<T> evict() override
+  {
+    std::unique_lock lock(mtx_);
+    if (keys_.empty()) {
+      return {};
+    }
+    std::uniform_int_distribution<int> dist(0, keys_.size() - 1);
+    auto it = keys_.begin();
+    std::advance(it, dist(rand_gen_));
+    T t = *it;
+    keys_.erase(it);
+    return t;
+  }
+
+private:
+  std::mutex mtx_;
+  std::mt19937 rand_gen_;
+  absl::flat_hash_set<T> keys_;
+};
+
+// Nanoseconds per operation of `n_ops` calls to `op`
+template <typename F>
+double
+time_per_op(size_t n_ops, F op)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n_ops; i++) {
+    op(i);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / n_ops;
+}
+
+// Fills the manager with `size` keys, then measures cache hits and replacements
+void
+run(const std::string &name, cache_manager<uint64_t> &&manager, size_t size)
+{
+  for (uint64_t key = 0; key < size; key++) {
+    manager.touch(key);
+  }
+
+  std::mt19937_64 rand_gen(1);
+  std::uniform_int_distribution<uint64_t> dist(0, size - 1);
+  const double hit = time_per_op(n_hits, [&](size_t) { manager.touch(dist(rand_gen)); });
+  const double replacement = time_per_op(n_replacements, [&](size_t i) {
+    manager.evict();
+    manager.touch(size + i);
+  });
+
+  fmt::print("{:<12} {:>10} {:>12.1f} {:>16.1f}\n", name, size, hit, replacement);
+}
+
+struct entry : public intrusive_lru_hook {
+  uint64_t key_;
+};
+
+// Same measurements for the intrusive LRU, whose entries are their own list nodes
+void
+run_intrusive(size_t size)
+{
+  intrusive_lru_manager<entry> manager;
+  std::vector<entry> entries(size);
+  for (uint64_t key = 0; key < size; key++) {
+    entries[key].key_ = key;
+    manager.touch(entries[key]);
+  }
+
+  std::mt19937_64 rand_gen(1);
+  std::uniform_int_distribution<uint64_t> dist(0, size - 1);
+  const double hit =
+      time_per_op(n_hits, [&](size_t) { manager.touch(entries[dist(rand_gen)]); });
+  // The evicted entry is reused for the new key, as a cache reuses its memory
+  const double replacement = time_per_op(n_replacements, [&](size_t i) {
+    entry *victim = manager.evict();
+    victim->key_ = size + i;
+    manager.touch(*victim);
+  });
+
+  fmt::print("{:<12} {:>10} {:>12.1f} {:>16.1f}\n", "intrusive", size, hit, replacement);
+}
+
+} // namespace
+
+int
+main()
+{
+  fmt::print("eviction manager cost (ns per operation)\n");
+  fmt::print("{:<12} {:>10} {:>12} {:>16}\n", "manager", "keys", "hit", "replacement");
+
+  for (const size_t size : {small_cache, large_cache}) {
+    run("linear rnd", linear_rnd_cache_manager<uint64_t>(), size);
+    run("rnd", rnd_cache_manager<uint64_t>(), size);
+    run("sampled", sampled_cache_manager<uint64_t>(), size);
+    run("lru", lru_cache_manager<uint64_t>(), size);
+    run_intrusive(size);
+    run("arc", arc_cache_manager<uint64_t>(), size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/tinylfu_manager.hpp"
+#include "fmt/core.h"
+#include <absl/container/flat_hash_set.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+constexpr size_t capacity = 10000;          // cached keys
+constexpr size_t trace_length = 2000000;    // accesses per trace
+constexpr size_t hot_keys = capacity / 2;   // hot set that fits in the cache
+constexpr size_t scan_length = 2 * capacity; // keys of each sequential scan
+constexpr double zipf_skew = 0.99;
+
+using trace = std::vector<uint64_t>;
+
+// Samples ranks in [0, n) with probability proportional to 1 / (rank + 1)^skew
+class zipf_distribution
+{
+public:
+  zipf_distribution(size_t n, double skew)
+      : cdf_(n)
+  {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+      cdf_[i] = sum;
+    }
+    for (auto &value : cdf_) {
+      value /= sum;
+    }
+  }
+
+  size_t operator()(std::mt19937_64 &rand_gen)
+  {
+    const double u = std::uniform_real_distribution<double>(0, 1)(rand_gen);
+    return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+// Skewed accesses over a key space ten times larger than the cache
+trace
+zipf_trace()
+{
+  std::mt19937_64 rand_gen(1);
+  zipf_distribution zipf(10 * capacity, zipf_skew);
+  trace accesses;
+  accesses.reserve(trace_length);
+  for (size_t i = 0; i < trace_length; i++) {
+    accesses.push_back(zipf(rand_gen));
+  }
+  return accesses;
+}
+
+// Skewed accesses to a hot set, interleaved with sequential scans of keys that are
+// never used again (e.g. a full read of a large file)
+trace
+scan_mixed_trace(double scan_fraction)
+{
+  std::mt19937_64 rand_gen(2);
+  std::bernoulli_distribution scan_dist(scan_fraction / scan_length);
+  zipf_distribution zipf(hot_keys, zipf_skew);
+  uint64_t next_scan_key = hot_keys;
+  trace accesses;
+  accesses.reserve(trace_length);
+  while (accesses.size() < trace_length) {
+    if (scan_dist(rand_gen)) {
+      for (size_t i = 0; i < scan_length && accesses.size() < trace_length; i++) {
+        accesses.push_back(next_scan_key++);
+      }
+    } else {
+      accesses.push_back(zipf(rand_gen));
+    }
+  }
+  return accesses;
+}
+
+// Repeated loop over slightly more keys than fit in the cache
+trace
+loop_trace()
+{
+  const size_t loop_length = capacity + capacity / 2;
+  trace accesses;
+  accesses.reserve(trace_length);
+  for (size_t i = 0; i < trace_length; i++) {
+    accesses.push_back(i % loop_length);
+  }
+  return accesses;
+}
+
+// Replays the trace on a cache of `capacity` keys and returns its hit ratio
+double
+hit_ratio(cache_manager<uint64_t> &manager, const trace &accesses)
+{
+  absl::flat_hash_set<uint64_t> cached;
+  size_t hits = 0;
+  for (const uint64_t key : accesses) {
+    if (cached.contains(key)) {
+      hits++;
+    } else {
+      if (cached.size() >= capacity) {
+        const auto victim = manager.evict();
+        if (victim) {
+          cached.erase(victim.value());
+        }
+      }
+      cached.insert(key);
+    }
+    manager.touch(key);
+  }
+  return static_cast<double>(hits) / accesses.size();
+}
+
+void
+run(const std::string &name, const trace &accesses)
+{
+  lru_cache_manager<uint64_t> lru;
+  rnd_cache_manager<uint64_t> rnd;
+  arc_cache_manager<uint64_t> arc;
+  tinylfu_cache_manager<uint64_t> lru_tinylfu(
+      std::make_unique<lru_cache_manager<uint64_t>>());
+  tinylfu_cache_manager<uint64_t> arc_tinylfu(
+      std::make_unique<arc_cache_manager<uint64_t>>());
+  fmt::print("{:<24} {:>8.2f} {:>8.2f} {:>8.2f} {:>12.2f} {:>12.2f}\n", name,
+             hit_ratio(lru, accesses) * 100, hit_ratio(rnd, accesses) * 100,
+             hit_ratio(arc, accesses) * 100, hit_ratio(lru_tinylfu, accesses) * 100,
+             hit_ratio(arc_tinylfu, accesses) * 100);
+}
+
+} // namespace
+
+int
+main()
+{
+  fmt::print("eviction policy hit ratio (%), cache of {} keys, {} accesses per trace\n",
+             capacity, trace_length);
+  fmt::print("{:<24} {:>8} {:>8} {:>8} {:>12} {:>12}\n", "trace", "lru", "rnd", "arc",
+             "lru+tinylfu", "arc+tinylfu");
+
+  run("zipf", zipf_trace());
+  run("zipf + 10% scans", scan_mixed_trace(0.1));
+  run("zipf + 30% scans", scan_mixed_trace(0.3));
+  run("loop", loop_trace());
+
+  return 0;
+}
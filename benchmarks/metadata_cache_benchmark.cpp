@@ -0,0 +1,103 @@
+#include "rsafefs/layers/metadata_cache/cache.hpp"
+#include "fmt/core.h"
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+constexpr size_t n_paths = 100000;                             // cached paths
+constexpr auto run_duration = std::chrono::milliseconds(1000); // per measurement
+
+// Measures the getattr hit throughput (in gets per second) of `n_threads` threads
+// looking up random paths of an already cached working set, like `ls -l` or `find`
+double
+hit_throughput(metadata_cache::cache &cache, const std::vector<std::string> &paths,
+               size_t n_threads)
+{
+  std::atomic<bool> stop = false;
+  std::atomic<size_t> total_gets = 0;
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < n_threads; i++) {
+    threads.emplace_back([&, i]() {
+      std::mt19937 rand_gen(i);
+      std::uniform_int_distribution<size_t> path_dist(0, n_paths - 1);
+      struct stat stbuf {
+      };
+      size_t gets = 0;
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        cache.get(paths[path_dist(rand_gen)], &stbuf);
+        gets++;
+      }
+      total_gets += gets;
+    });
+  }
+
+  std::this_thread::sleep_for(run_duration);
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return total_gets / std::chrono::duration<double>(run_duration).count();
+}
+
+double
+run(size_t n_shards, size_t n_threads)
+{
+  metadata_cache::cache::config config{
+      .size_ = 2 * n_paths, // everything fits, only hits are measured
+      .shards_ = n_shards,
+      .time_out_ = 0,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 0,
+      .negative_time_out_ = 0,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+
+  std::vector<std::string> paths;
+  paths.reserve(n_paths);
+  struct stat stbuf {
+  };
+  for (size_t i = 0; i < n_paths; i++) {
+    paths.push_back(fmt::format("/dir_{}/file_{}", i % 100, i));
+    cache.put(paths.back(), &stbuf);
+  }
+
+  return hit_throughput(cache, paths, n_threads);
+}
+
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  const size_t n_shards = argc > 1 ? std::stoul(argv[1]) : 16;
+  const size_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+
+  fmt::print("metadata cache getattr hit throughput ({} paths, Mgets/s)\n", n_paths);
+  fmt::print("{:>8} {:>12} {:>12}\n", "threads", "1 shard",
+             fmt::format("{} shards", n_shards));
+
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+    const double single = run(1, n_threads) / 1e6;
+    const double sharded = run(n_shards, n_threads) / 1e6;
+    fmt::print("{:>8} {:>12.3f} {:>12.3f}\n", n_threads, single, sharded);
+  }
+
+  return 0;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "rsafefs/common/cache/cache_manager.hpp"
+#include <absl/container/flat_hash_map.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+namespace rsafefs
+{
+
+// Adaptive Replacement Cache (Megiddo and Modha). Resident keys seen once (t1) and more
+// than once (t2) are kept apart, so a scan only flushes t1. The ghosts of recently
+// evicted keys (b1, b2) steer the target size of t1 towards the list that would have
+// had the hit. The capacity is the largest number of resident keys seen, since the
+// caches decide when to evict based on their own size
+template <typename T> class arc_cache_manager : public cache_manager<T>
+{
+public:
+  arc_cache_manager()
+      : target_t1_(0)
+      , capacity_(0)
+  {
+  }
+
+  void touch(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto it = map_.find(t);
+    if (it == map_.end()) {
+      insert(t1, t);
+      update_capacity();
+      return;
+    }
+
+    const list_id id = it->second.list_;
+    if (id == t1 || id == t2) {
+      lists_[t2].splice(lists_[t2].begin(), lists_[id], it->second.it_);
+      it->second.list_ = t2;
+      return;
+    }
+    if (id == b1) {
+      // Would have been a hit with a larger t1
+      const size_t delta = std::max<size_t>(1, lists_[b2].size() / lists_[b1].size());
+      target_t1_ = std::min(capacity_, target_t1_ + delta);
+    } else if (id == b2) {
+      const size_t delta = std::max<size_t>(1, lists_[b1].size() / lists_[b2].size());
+      target_t1_ = target_t1_ - std::min(target_t1_, delta);
+    }
+    erase(it);
+    insert(t2, t);
+    update_capacity();
+  }
+
+  void remove(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto it = map_.find(t);
+    if (it != map_.end()) {
+      erase(it);
+    }
+  }
+
+  std::optional<T> evict() override
+  {
+    std::unique_lock lock(mtx_);
+    const size_t size_t1 = lists_[t1].size();
+    if (size_t1 + lists_[t2].size() == 0) {
+      return {};
+    }
+
+    const bool from_t1 = size_t1 > 0 && (size_t1 > target_t1_ || lists_[t2].empty());
+    const list_id from = from_t1 ? t1 : t2;
+    T t = lists_[from].back();
+    erase(map_.find(t));
+    insert(from_t1 ? b1 : b2, t);
+    trim_ghosts();
+    return t;
+  }
+
+private:
+  enum list_id { t1, t2, b1, b2 };
+
+  struct entry {
+    list_id list_;
+    typename std::list<T>::iterator it_;
+  };
+
+  void insert(list_id id, const T &t)
+  {
+    lists_[id].push_front(t);
+    map_[t] = {id, lists_[id].begin()};
+  }
+
+  void erase(typename absl::flat_hash_map<T, entry>::iterator it)
+  {
+    lists_[it->second.list_].erase(it->second.it_);
+    map_.erase(it);
+  }
+
+  void update_capacity()
+  {
+    capacity_ = std::max(capacity_, lists_[t1].size() + lists_[t2].size());
+  }
+
+  // Ghosts only remember as many keys as fit in the cache
+  void trim_ghosts()
+  {
+    while (!lists_[b1].empty() && lists_[t1].size() + lists_[b1].size() > capacity_) {
+      map_.erase(lists_[b1].back());
+      lists_[b1].pop_back();
+    }
+    while (!lists_[b2].empty() && map_.size() > 2 * capacity_) {
+      map_.erase(lists_[b2].back());
+      lists_[b2].pop_back();
+    }
+  }
+
+  std::mutex mtx_;
+  std::list<T> lists_[4];
+  absl::flat_hash_map<T, entry> map_;
+  size_t target_t1_;
+  size_t capacity_;
+};
+
+} // namespace rsafefs
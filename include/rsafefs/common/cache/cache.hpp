@@ -0,0 +1,278 @@
+#pragma once
+
+#include "rsafefs/common/cache/intrusive_lru.hpp"
+#include "rsafefs/common/cache/read_buffer.hpp"
+#include <absl/hash/hash.h>
+#include <cstddef>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace rsafefs::common
+{
+
+// A value in the cache, with the links of the intrusive LRU and its key in the map
+template <typename Key, typename Value> struct cache_entry : public intrusive_lru_hook {
+  explicit cache_entry(Value value)
+      : value_(std::move(value))
+      , key_(nullptr)
+  {
+  }
+
+  Value value_;
+  const Key *key_;
+};
+
+// Eviction by one of the managers of keys, called on its concrete type
+template <typename Manager> class managed_policy
+{
+public:
+  template <typename... Args>
+  explicit managed_policy(Args &&...args)
+      : manager_(std::forward<Args>(args)...)
+  {
+  }
+
+  template <typename Key, typename Entry> void touch(const Key &key, Entry &)
+  {
+    manager_.touch(key);
+  }
+
+  template <typename Key, typename Entry> void remove(const Key &key, Entry &)
+  {
+    manager_.remove(key);
+  }
+
+  auto evict() { return manager_.evict(); }
+
+private:
+  Manager manager_;
+};
+
+// LRU linked through the entries, nothing is allocated nor copied but the victim key
+template <typename Key, typename Value> class intrusive_lru_policy
+{
+public:
+  using entry = cache_entry<Key, Value>;
+
+  void touch(const Key &, entry &entry) { lru_.touch(entry); }
+
+  void remove(const Key &, entry &entry) { lru_.remove(entry); }
+
+  std::optional<Key> evict()
+  {
+    const entry *victim = lru_.evict();
+    if (victim == nullptr) {
+      return {};
+    }
+    return *victim->key_;
+  }
+
+private:
+  intrusive_lru_manager<entry> lru_;
+};
+
+// Every value takes one unit of the capacity
+template <typename Value> struct unit_size {
+  size_t operator()(const Value &) const { return 1; }
+};
+
+// Values never expire
+template <typename Value> struct always_valid {
+  bool operator()(const Value &) const { return true; }
+};
+
+// Map, locking, expiration and size accounting shared by the caches. The eviction
+// policy, the size of a value and whether it is still valid are template parameters,
+// so the hit path is inlined instead of going through virtual calls. Hits only go to
+// the policy through a read buffer, drained before any entry leaves the map
+template <typename Key, typename Value, typename Policy,
+          typename SizeFn = unit_size<Value>, typename ValidFn = always_valid<Value>>
+class cache
+{
+public:
+  using entry = cache_entry<Key, Value>;
+
+  template <typename... PolicyArgs>
+  cache(size_t capacity, SizeFn size_fn, ValidFn valid_fn, PolicyArgs &&...policy_args)
+      : capacity_(capacity)
+      , size_(0)
+      , size_fn_(std::move(size_fn))
+      , valid_fn_(std::move(valid_fn))
+      , policy_(std::forward<PolicyArgs>(policy_args)...)
+  {
+  }
+
+  cache(const cache &) = delete;
+
+  cache &operator=(const cache &) = delete;
+
+  // Inserts or replaces the value of a key, evicting others until it fits
+  void put(const Key &key, Value value)
+  {
+    const size_t value_size = size_fn_(value);
+    std::unique_lock lock(mtx_);
+    drain_hits();
+    const auto map_iterator = map_.find(key);
+    if (map_iterator != map_.end()) {
+      // Replaced in place, the key keeps its node and its place in the policy
+      entry &entry = map_iterator->second;
+      size_ = size_ - size_fn_(entry.value_) + value_size;
+      entry.value_ = std::move(value);
+      policy_.touch(key, entry);
+      evict_to_capacity(0);
+      return;
+    }
+    evict_to_capacity(value_size);
+
+    const auto [emplaced_iterator, inserted] = map_.try_emplace(key, std::move(value));
+    entry &entry = emplaced_iterator->second;
+    entry.key_ = &emplaced_iterator->first;
+    size_ += value_size;
+    policy_.touch(key, entry);
+  }
+
+  // Copies the value of a key, expired values are dropped
+  bool get(const Key &key, Value &value)
+  {
+    return read(key, [&](const Value &cached) { value = cached; });
+  }
+
+  // Calls f(value) on the value of a key under the shared lock, without copying it.
+  // Expired values are dropped, f mustn't use the cache
+  template <typename F> bool read(const Key &key, F &&f)
+  {
+    std::shared_lock shared_lock(mtx_);
+    const auto map_iterator = map_.find(key);
+    if (map_iterator == map_.end()) {
+      return false;
+    }
+
+    entry &entry = map_iterator->second;
+    if (!valid_fn_(entry.value_)) {
+      shared_lock.unlock();
+
+      // Unless it was replaced in the meantime
+      std::unique_lock lock(mtx_);
+      const auto expired_iterator = map_.find(key);
+      if (expired_iterator != map_.end() && !valid_fn_(expired_iterator->second.value_)) {
+        drain_hits();
+        erase(expired_iterator);
+      }
+      return false;
+    }
+
+    f(static_cast<const Value &>(entry.value_));
+    if (hits_.record(&entry)) {
+      hits_.try_drain([this](cache::entry *hit) { policy_.touch(*hit->key_, *hit); });
+    }
+    return true;
+  }
+
+  void remove(const Key &key)
+  {
+    std::unique_lock lock(mtx_);
+    drain_hits();
+    erase(key);
+  }
+
+  // Removes the values for which pred(key, value) holds, returns how many were removed
+  template <typename Pred> size_t remove_if(Pred &&pred)
+  {
+    std::unique_lock lock(mtx_);
+    drain_hits();
+    size_t removed = 0;
+    for (auto map_iterator = map_.begin(); map_iterator != map_.end();) {
+      const auto current = map_iterator++;
+      if (pred(current->first, current->second.value_)) {
+        erase(current);
+        removed++;
+      }
+    }
+    return removed;
+  }
+
+  // Evicts values until their sizes add up to `amount`, returns the size evicted
+  size_t shrink(size_t amount)
+  {
+    std::unique_lock lock(mtx_);
+    drain_hits();
+    const size_t old_size = size_;
+    while (old_size - size_ < amount && !map_.empty()) {
+      const std::optional<Key> victim = policy_.evict();
+      if (!victim) {
+        break;
+      }
+      erase(victim.value());
+    }
+    return old_size - size_;
+  }
+
+  // Calls f(key, value) on every valid value, the cache mustn't be used from f
+  template <typename F> void for_each(F &&f) const
+  {
+    std::shared_lock lock(mtx_);
+    for (const auto &[key, entry] : map_) {
+      if (valid_fn_(entry.value_)) {
+        f(key, entry.value_);
+      }
+    }
+  }
+
+  // Sum of the sizes of the cached values
+  [[nodiscard]] size_t size() const
+  {
+    std::shared_lock lock(mtx_);
+    return size_;
+  }
+
+  [[nodiscard]] read_buffer_stats hit_buffer_stats() const { return hits_.get_stats(); }
+
+private:
+  using map = std::unordered_map<Key, entry, absl::Hash<Key>>;
+
+  // Requires the exclusive lock and the hits drained
+  void erase(const Key &key)
+  {
+    const auto map_iterator = map_.find(key);
+    if (map_iterator != map_.end()) {
+      erase(map_iterator);
+    }
+  }
+
+  void erase(typename map::iterator map_iterator)
+  {
+    policy_.remove(map_iterator->first, map_iterator->second);
+    size_ -= size_fn_(map_iterator->second.value_);
+    map_.erase(map_iterator);
+  }
+
+  // Evicts values until `incoming` more fits, requires the exclusive lock
+  void evict_to_capacity(size_t incoming)
+  {
+    while (size_ + incoming > capacity_ && !map_.empty()) {
+      const std::optional<Key> victim = policy_.evict();
+      if (!victim) {
+        break;
+      }
+      erase(victim.value());
+    }
+  }
+
+  void drain_hits()
+  {
+    hits_.drain([this](entry *hit) { policy_.touch(*hit->key_, *hit); });
+  }
+
+  const size_t capacity_;
+  size_t size_;
+  SizeFn size_fn_;
+  ValidFn valid_fn_;
+  Policy policy_;
+  map map_;
+  read_buffer<entry> hits_;
+  mutable std::shared_mutex mtx_;
+};
+
+} // namespace rsafefs::common
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <absl/hash/hash.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace rsafefs
+{
+
+// Count-min sketch of how often keys were used. Every key has a counter in each of the
+// four rows and its estimate is the smallest of them. Counters saturate at 15 and are
+// halved after 10 times as many uses as there are counters in a row, so old popularity
+// fades away
+template <typename T> class frequency_sketch
+{
+public:
+  static constexpr uint8_t max_frequency = 15;
+
+  frequency_sketch()
+      : width_(0)
+      , additions_(0)
+  {
+  }
+
+  // Grows the sketch to track at least n keys with four counters per key in each row,
+  // few keys share all their counters then. The counters are reset when it grows
+  void resize(size_t n)
+  {
+    if (4 * n <= width_) {
+      return;
+    }
+    width_ = std::bit_ceil(4 * n);
+    counters_.assign(rows * width_, 0);
+    additions_ = 0;
+  }
+
+  void increment(const T &t)
+  {
+    if (width_ == 0) {
+      return;
+    }
+    const uint64_t hash = absl::Hash<T>{}(t);
+    bool incremented = false;
+    for (size_t row = 0; row < rows; row++) {
+      uint8_t &counter = counters_[row * width_ + index(hash, row)];
+      if (counter < max_frequency) {
+        counter++;
+        incremented = true;
+      }
+    }
+    if (incremented && ++additions_ >= 10 * width_) {
+      age();
+    }
+  }
+
+  [[nodiscard]] uint8_t estimate(const T &t) const
+  {
+    if (width_ == 0) {
+      return 0;
+    }
+    const uint64_t hash = absl::Hash<T>{}(t);
+    uint8_t frequency = max_frequency;
+    for (size_t row = 0; row < rows; row++) {
+      frequency = std::min(frequency, counters_[row * width_ + index(hash, row)]);
+    }
+    return frequency;
+  }
+
+private:
+  static constexpr size_t rows = 4;
+  static constexpr uint64_t seeds[rows] = {0xc3a5c85c97cb3127, 0xb492b66fbe98f273,
+                                           0x9ae16a3b2f90404f, 0xcbf29ce484222325};
+
+  [[nodiscard]] size_t index(uint64_t hash, size_t row) const
+  {
+    uint64_t x = (hash + seeds[row]) * 0x9e3779b97f4a7c15;
+    x ^= x >> 32;
+    return x & (width_ - 1);
+  }
+
+  void age()
+  {
+    for (auto &counter : counters_) {
+      counter >>= 1;
+    }
+    additions_ /= 2;
+  }
+
+  size_t width_;
+  size_t additions_;
+  std::vector<uint8_t> counters_;
+};
+
+} // namespace rsafefs
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <mutex>
+
+namespace rsafefs
+{
+
+template <typename T> class intrusive_lru_manager;
+
+// Recency links embedded in a cache entry. A copy of an entry isn't in any list, so
+// copies start unlinked and assignments keep the links of the target
+class intrusive_lru_hook
+{
+public:
+  intrusive_lru_hook()
+      : prev_(nullptr)
+      , next_(nullptr)
+  {
+  }
+
+  intrusive_lru_hook(const intrusive_lru_hook &)
+      : intrusive_lru_hook()
+  {
+  }
+
+  intrusive_lru_hook &operator=(const intrusive_lru_hook &) { return *this; }
+
+  [[nodiscard]] bool is_linked() const { return next_ != nullptr; }
+
+private:
+  intrusive_lru_hook *prev_;
+  intrusive_lru_hook *next_;
+
+  template <typename T> friend class intrusive_lru_manager;
+};
+
+// LRU over entries that derive from intrusive_lru_hook. Unlike lru_cache_manager it
+// doesn't allocate nor copy keys: the entries are the list. Callers must keep an entry
+// alive while they touch it and remove it before destroying it
+template <typename T> class intrusive_lru_manager
+{
+public:
+  intrusive_lru_manager()
+  {
+    head_.prev_ = &head_;
+    head_.next_ = &head_;
+  }
+
+  intrusive_lru_manager(const intrusive_lru_manager &) = delete;
+
+  intrusive_lru_manager &operator=(const intrusive_lru_manager &) = delete;
+
+  void touch(T &t)
+  {
+    intrusive_lru_hook &hook = t;
+    std::unique_lock lock(mtx_);
+    if (hook.is_linked()) {
+      unlink(hook);
+    }
+    hook.prev_ = &head_;
+    hook.next_ = head_.next_;
+    head_.next_->prev_ = &hook;
+    head_.next_ = &hook;
+  }
+
+  void remove(T &t)
+  {
+    intrusive_lru_hook &hook = t;
+    std::unique_lock lock(mtx_);
+    if (hook.is_linked()) {
+      unlink(hook);
+    }
+  }
+
+  // Unlinks the least recently used entry, nullptr when there is none
+  T *evict()
+  {
+    std::unique_lock lock(mtx_);
+    if (head_.prev_ == &head_) {
+      return nullptr;
+    }
+    intrusive_lru_hook &hook = *head_.prev_;
+    unlink(hook);
+    return static_cast<T *>(&hook);
+  }
+
+private:
+  static void unlink(intrusive_lru_hook &hook)
+  {
+    hook.prev_->next_ = hook.next_;
+    hook.next_->prev_ = hook.prev_;
+    hook.prev_ = nullptr;
+    hook.next_ = nullptr;
+  }
+
+  std::mutex mtx_;
+  // Sentinel of the circular list: next is the most recently used entry
+  intrusive_lru_hook head_;
+};
+
+} // namespace rsafefs
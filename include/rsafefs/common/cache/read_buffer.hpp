@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace rsafefs
+{
+
+struct read_buffer_stats {
+  size_t recorded_;
+  size_t dropped_;
+
+  [[nodiscard]] double drop_rate() const
+  {
+    const size_t total = recorded_ + dropped_;
+    return total == 0 ? 0.0 : static_cast<double>(dropped_) / total;
+  }
+
+  read_buffer_stats &operator+=(const read_buffer_stats &other)
+  {
+    recorded_ += other.recorded_;
+    dropped_ += other.dropped_;
+    return *this;
+  }
+};
+
+// Lossy buffers of the entries touched by cache hits, in the way of Caffeine. Threads
+// record into one of several ring buffers without taking a lock, and a touch is simply
+// dropped when its buffer is full or contended: the eviction policy only needs a sample
+// of the recency. Whoever gets the drain lock replays the buffered touches on the policy
+// in a batch. The entries must stay alive until the buffers are drained, so callers
+// drain them before removing an entry
+template <typename T> class read_buffer
+{
+public:
+  read_buffer()
+      : n_recorded_(0)
+      , n_dropped_(0)
+  {
+  }
+
+  read_buffer(const read_buffer &) = delete;
+
+  read_buffer &operator=(const read_buffer &) = delete;
+
+  // Returns true when the buffer of the caller is worth draining
+  bool record(T *t)
+  {
+    ring &ring = rings_[ring_index()];
+    const uint64_t head = ring.head_.load(std::memory_order_acquire);
+    uint64_t tail = ring.tail_.load(std::memory_order_relaxed);
+    const uint64_t size = tail - head;
+    if (size >= ring_size ||
+        !ring.tail_.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+      n_dropped_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    ring.slots_[tail % ring_size].store(t, std::memory_order_release);
+    n_recorded_.fetch_add(1, std::memory_order_relaxed);
+    return size + 1 >= ring_size / 2;
+  }
+
+  // Drains unless another thread is already doing it
+  template <typename F> void try_drain(F &&touch)
+  {
+    std::unique_lock lock(drain_mtx_, std::try_to_lock);
+    if (lock.owns_lock()) {
+      drain_locked(touch);
+    }
+  }
+
+  template <typename F> void drain(F &&touch)
+  {
+    std::unique_lock lock(drain_mtx_);
+    drain_locked(touch);
+  }
+
+  [[nodiscard]] read_buffer_stats get_stats() const
+  {
+    return {
+        .recorded_ = n_recorded_.load(std::memory_order_relaxed),
+        .dropped_ = n_dropped_.load(std::memory_order_relaxed),
+    };
+  }
+
+private:
+  static constexpr size_t n_rings = 16;
+  static constexpr size_t ring_size = 32;
+
+  // Only the drainer moves the head, recording threads race on the tail
+  struct alignas(64) ring {
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> tail_{0};
+    std::array<std::atomic<T *>, ring_size> slots_{};
+  };
+
+  static size_t ring_index()
+  {
+    static thread_local const size_t index =
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) % n_rings;
+    return index;
+  }
+
+  template <typename F> void drain_locked(F &touch)
+  {
+    for (ring &ring : rings_) {
+      uint64_t head = ring.head_.load(std::memory_order_relaxed);
+      const uint64_t tail = ring.tail_.load(std::memory_order_acquire);
+      for (; head != tail; head++) {
+        // A slot claimed but not written yet ends the batch of this ring
+        T *t = ring.slots_[head % ring_size].exchange(nullptr, std::memory_order_acquire);
+        if (t == nullptr) {
+          break;
+        }
+        touch(t);
+      }
+      ring.head_.store(head, std::memory_order_release);
+    }
+  }
+
+  std::array<ring, n_rings> rings_;
+  std::mutex drain_mtx_;
+  std::atomic<size_t> n_recorded_;
+  std::atomic<size_t> n_dropped_;
+};
+
+} // namespace rsafefs
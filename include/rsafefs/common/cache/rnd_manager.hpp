@@ -1,13 +1,16 @@
 #pragma once
 
 #include "rsafefs/common/cache/cache_manager.hpp"
-#include <absl/container/flat_hash_set.h>
+#include <absl/container/flat_hash_map.h>
 #include <mutex>
 #include <random>
+#include <vector>
 
 namespace rsafefs
 {
 
+// Keys are kept densely in a vector, indexed by a map, so a random one is picked and
+// swapped with the last one to be removed in constant time
 template <typename T> class rnd_cache_manager : public cache_manager<T>
 {
 public:
@@ -19,13 +22,19 @@ public:
   void touch(const T &t) override
   {
     std::unique_lock lock(mtx_);
-    keys_.insert(t);
+    const auto [it, inserted] = index_.try_emplace(t, keys_.size());
+    if (inserted) {
+      keys_.push_back(t);
+    }
   }
 
   void remove(const T &t) override
   {
     std::unique_lock lock(mtx_);
-    keys_.erase(t);
+    const auto it = index_.find(t);
+    if (it != index_.end()) {
+      erase(it->second);
+    }
   }
 
   std::optional<T> evict() override
@@ -34,18 +43,28 @@ public:
     if (keys_.empty()) {
       return {};
     }
-    std::uniform_int_distribution<int> dist(0, keys_.size() - 1);
-    auto it = keys_.begin();
-    std::advance(it, dist(rand_gen_));
-    T t = *it;
-    keys_.erase(it);
+    std::uniform_int_distribution<size_t> dist(0, keys_.size() - 1);
+    const size_t i = dist(rand_gen_);
+    T t = keys_[i];
+    erase(i);
     return t;
   }
 
 private:
+  void erase(size_t i)
+  {
+    index_.erase(keys_[i]);
+    if (i != keys_.size() - 1) {
+      keys_[i] = std::move(keys_.back());
+      index_[keys_[i]] = i;
+    }
+    keys_.pop_back();
+  }
+
   std::mutex mtx_;
   std::mt19937 rand_gen_;
-  absl::flat_hash_set<T> keys_;
+  std::vector<T> keys_;
+  absl::flat_hash_map<T, size_t> index_;
 };
 
 } // namespace rsafefs
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "rsafefs/common/cache/cache_manager.hpp"
+#include <absl/container/flat_hash_map.h>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace rsafefs
+{
+
+// Approximated LRU in the way of Redis: every key remembers when it was last used and
+// the oldest of a few keys sampled at random is evicted. Keys are kept densely in a
+// vector, so touches and evictions take constant time whatever the number of keys
+template <typename T> class sampled_cache_manager : public cache_manager<T>
+{
+public:
+  explicit sampled_cache_manager(size_t samples = 5)
+      : samples_(samples)
+      , clock_(0)
+      , rand_gen_(std::random_device{}())
+  {
+  }
+
+  void touch(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto [it, inserted] = index_.try_emplace(t, entries_.size());
+    if (inserted) {
+      entries_.push_back({t, clock_++});
+    } else {
+      entries_[it->second].last_used_ = clock_++;
+    }
+  }
+
+  void remove(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto it = index_.find(t);
+    if (it != index_.end()) {
+      erase(it->second);
+    }
+  }
+
+  std::optional<T> evict() override
+  {
+    std::unique_lock lock(mtx_);
+    if (entries_.empty()) {
+      return {};
+    }
+    std::uniform_int_distribution<size_t> dist(0, entries_.size() - 1);
+    size_t oldest = dist(rand_gen_);
+    for (size_t i = 1; i < samples_; i++) {
+      const size_t sample = dist(rand_gen_);
+      if (entries_[sample].last_used_ < entries_[oldest].last_used_) {
+        oldest = sample;
+      }
+    }
+    T t = entries_[oldest].key_;
+    erase(oldest);
+    return t;
+  }
+
+private:
+  struct entry {
+    T key_;
+    uint64_t last_used_;
+  };
+
+  void erase(size_t i)
+  {
+    index_.erase(entries_[i].key_);
+    if (i != entries_.size() - 1) {
+      entries_[i] = std::move(entries_.back());
+      index_[entries_[i].key_] = i;
+    }
+    entries_.pop_back();
+  }
+
+  const size_t samples_;
+  std::mutex mtx_;
+  uint64_t clock_;
+  std::mt19937 rand_gen_;
+  std::vector<entry> entries_;
+  absl::flat_hash_map<T, size_t> index_;
+};
+
+} // namespace rsafefs
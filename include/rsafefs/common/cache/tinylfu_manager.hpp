@@ -0,0 +1,131 @@
+#pragma once
+
+#include "rsafefs/common/cache/cache_manager.hpp"
+#include "rsafefs/common/cache/frequency_sketch.hpp"
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace rsafefs
+{
+
+// W-TinyLFU admission in front of another manager. New keys enter a small LRU window
+// (1% of the keys) and only move to the main manager when their estimated frequency
+// beats the one of the key it would evict, the loser is the one evicted. Keys used once,
+// like the blocks of a scan, therefore never push out popular keys. A victim that wins
+// is inserted again on the main manager. The capacity is the largest number of resident
+// keys seen, since the caches decide when to evict based on their own size
+template <typename T> class tinylfu_cache_manager : public cache_manager<T>
+{
+public:
+  explicit tinylfu_cache_manager(std::unique_ptr<cache_manager<T>> main)
+      : main_(std::move(main))
+      , capacity_(0)
+  {
+  }
+
+  void touch(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto it = window_map_.find(t);
+    if (it != window_map_.end()) {
+      sketch_.increment(t);
+      window_.splice(window_.begin(), window_, it->second);
+      return;
+    }
+    if (main_keys_.contains(t)) {
+      sketch_.increment(t);
+      main_->touch(t);
+      return;
+    }
+
+    window_.push_front(t);
+    window_map_[t] = window_.begin();
+    if (window_.size() + main_keys_.size() > capacity_) {
+      capacity_ = window_.size() + main_keys_.size();
+      sketch_.resize(capacity_);
+    }
+    sketch_.increment(t);
+    // The main manager fills up freely until the cache starts evicting
+    while (window_.size() > window_limit()) {
+      admit();
+    }
+  }
+
+  void remove(const T &t) override
+  {
+    std::unique_lock lock(mtx_);
+    const auto it = window_map_.find(t);
+    if (it != window_map_.end()) {
+      window_.erase(it->second);
+      window_map_.erase(it);
+    } else if (main_keys_.erase(t) > 0) {
+      main_->remove(t);
+    }
+  }
+
+  std::optional<T> evict() override
+  {
+    std::unique_lock lock(mtx_);
+    if (main_keys_.empty()) {
+      return window_.empty() ? std::nullopt : std::optional<T>(evict_window());
+    }
+
+    auto victim = main_->evict();
+    if (!victim) {
+      return window_.empty() ? std::nullopt : std::optional<T>(evict_window());
+    }
+    main_keys_.erase(victim.value());
+    if (window_.size() < window_limit()) {
+      return victim;
+    }
+
+    // The oldest key of the full window competes with the victim for its place
+    if (sketch_.estimate(window_.back()) > sketch_.estimate(victim.value())) {
+      admit();
+      return victim;
+    }
+    // Removed first, so the main manager doesn't mistake it for the reuse of a key
+    main_->remove(victim.value());
+    main_->touch(victim.value());
+    main_keys_.insert(victim.value());
+    return evict_window();
+  }
+
+private:
+  [[nodiscard]] size_t window_limit() const
+  {
+    return std::max<size_t>(1, capacity_ / 100);
+  }
+
+  // Moves the oldest key of the window to the main manager
+  void admit()
+  {
+    const T t = window_.back();
+    window_.pop_back();
+    window_map_.erase(t);
+    main_keys_.insert(t);
+    main_->touch(t);
+  }
+
+  T evict_window()
+  {
+    T t = window_.back();
+    window_.pop_back();
+    window_map_.erase(t);
+    return t;
+  }
+
+  std::mutex mtx_;
+  std::unique_ptr<cache_manager<T>> main_;
+  absl::flat_hash_set<T> main_keys_;
+  std::list<T> window_;
+  absl::flat_hash_map<T, typename std::list<T>::iterator> window_map_;
+  frequency_sketch<T> sketch_;
+  size_t capacity_;
+};
+
+} // namespace rsafefs
@@ -3,6 +3,8 @@
 #include "rsafefs/fuse_wrapper/fuse31.hpp"
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 namespace rsafefs::fuse_rpc
 {
@@ -85,6 +87,13 @@ public:
   virtual int listxattr(const char *path, char *list, size_t size) = 0;
 
   virtual int removexattr(const char *path, const char *name) = 0;
+
+  // Attributes of several paths in one request. The paths whose getattr failed are left
+  // out of `attributes`, the ones that don't exist are listed in `missing`
+  virtual int
+  getattr_compound(const std::vector<std::string> &paths,
+                   std::vector<std::pair<std::string, struct stat>> &attributes,
+                   std::vector<std::string> &missing) = 0;
 };
 
 } // namespace rsafefs::fuse_rpc
@@ -3,6 +3,7 @@
 #include "fuse_operations.grpc.pb.h"
 #include "rsafefs/fuse_rpc/grpc/channel.hpp"
 #include "rsafefs/fuse_rpc/grpc/sync_client.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
 #include <asio/io_context.hpp>
 #include <asio/steady_timer.hpp>
 #include <condition_variable>
@@ -15,7 +16,7 @@ namespace rsafefs::fuse_rpc::grpc
 
 using CompletionQueue = ::grpc::CompletionQueue;
 
-class async_client : public fuse_rpc::grpc::sync_client
+class async_client : public fuse_rpc::grpc::sync_client, public utils::memory_consumer
 {
 public:
   struct config : fuse_rpc::grpc::sync_client::config {
@@ -46,6 +47,14 @@ public:
 
   int fsync(const char *path, int isdatasync, struct fuse_file_info *fi) override;
 
+  [[nodiscard]] size_t memory_usage() const override;
+
+  // Written blocks are never read back
+  [[nodiscard]] size_t memory_hits() const override;
+
+  // Flushes the queued blocks and waits for them to be sent, returns the bytes freed
+  size_t shrink(size_t bytes) override;
+
 private:
   static void async_complete(CompletionQueue &cq);
 
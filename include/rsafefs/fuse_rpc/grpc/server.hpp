@@ -548,6 +548,20 @@ private:
     proto::RemovexattrReply reply_;
   };
 
+  class getattr_compound_data : unary_call_data
+  {
+  public:
+    getattr_compound_data(Service &service, ServerCompletionQueue *cq,
+                          const fuse_operations &operations);
+
+    void proceed(bool ok) override;
+
+  private:
+    ServerAsyncResponseWriter<proto::GetattrCompoundReply> responder_;
+    proto::GetattrCompoundRequest request_;
+    proto::GetattrCompoundReply reply_;
+  };
+
   class stream_read_data : bidi_stream_call_data
   {
   public:
@@ -95,6 +95,10 @@ public:
 
   int removexattr(const char *path, const char *name) override;
 
+  int getattr_compound(const std::vector<std::string> &paths,
+                       std::vector<std::pair<std::string, struct stat>> &attributes,
+                       std::vector<std::string> &missing) override;
+
 protected:
   struct read_stream {
     explicit read_stream(const std::unique_ptr<fuse_grpc_proto::FuseOps::Stub> &stub);
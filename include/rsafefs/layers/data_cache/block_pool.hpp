@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rsafefs::data_cache
+{
+
+// Preallocated arena of same-size block buffers, recycled through a free list. The
+// pages of the arena only become resident once written, and free buffers can give them
+// back to the system, so the pool holds no more memory than the cache needs
+class block_pool
+{
+public:
+  struct stats {
+    stats &operator+=(const stats &other);
+
+    [[nodiscard]] double utilization() const;
+
+    size_t capacity_;
+    size_t used_;
+    size_t peak_used_;
+    size_t free_list_length_;
+    // Free buffers whose pages aren't resident, either never used or trimmed
+    size_t cold_;
+    size_t failed_allocations_;
+    size_t hugepages_;
+  };
+
+  class releaser
+  {
+  public:
+    releaser(block_pool *pool = nullptr);
+
+    void operator()(char *buf) const;
+
+  private:
+    block_pool *pool_;
+  };
+
+  using buffer = std::unique_ptr<char[], releaser>;
+
+  block_pool(size_t n_blocks, size_t block_size, bool hugepages);
+
+  ~block_pool();
+
+  block_pool(const block_pool &) = delete;
+
+  block_pool &operator=(const block_pool &) = delete;
+
+  // Returns an empty buffer when every block of the pool is in use. Free buffers still
+  // resident are handed out first
+  buffer allocate();
+
+  // Gives the pages of the free buffers back to the system, returns the bytes of the
+  // buffers no longer resident. Pages shared with a buffer in use are kept
+  size_t trim();
+
+  // Bytes of the buffers in use or free with their pages resident
+  [[nodiscard]] size_t resident_bytes();
+
+  [[nodiscard]] stats get_stats();
+
+private:
+  void release(char *buf);
+
+  const size_t n_blocks_;
+  const size_t block_size_;
+  size_t arena_size_;
+  char *arena_;
+  bool hugepages_;
+
+  std::mutex mtx_;
+  std::vector<char *> free_list_;
+  std::vector<char *> cold_list_;
+  size_t peak_used_;
+  size_t failed_allocations_;
+};
+
+} // namespace rsafefs::data_cache
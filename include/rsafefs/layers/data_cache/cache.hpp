@@ -1,43 +1,90 @@
 #pragma once
 
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/cache.hpp"
+#include "rsafefs/common/cache/intrusive_lru.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/read_buffer.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "rsafefs/common/cache/tinylfu_manager.hpp"
 #include "rsafefs/fuse_wrapper/fuse31.hpp"
+#include "rsafefs/layers/data_cache/block_pool.hpp"
+#include "rsafefs/layers/data_cache/disk_tier.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
+#include "rsafefs/utils/path_rules.hpp"
+#include "rsafefs/utils/warm_start.hpp"
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/node_hash_map.h>
 #include <absl/hash/hash.h>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace rsafefs::data_cache
 {
-using key = std::pair<std::string, size_t>;
+using file_id = uint64_t;
+using key = std::pair<file_id, size_t>;
 
-class cache
+// Every shard owns an eviction policy of the generic cache, picked at runtime, so the
+// hits and the evictions go through a single visit of a variant instead of virtual calls
+class cache : public utils::memory_consumer
 {
 public:
-  class eviction_policy
-  {
-  public:
-    virtual ~eviction_policy() = default;
-
-  private:
-    virtual void touch(const key &key) = 0;
-    virtual void remove(const key &key) = 0;
-    virtual std::optional<key> evict() = 0;
-
-    friend class data_cache::cache;
-  };
+  enum class eviction_policy { lru, rnd, arc, sampled };
 
   struct config {
     size_t size_;
     size_t block_size_;
+    size_t shards_;
+    size_t max_fetch_blocks_;
+    bool hugepages_;
     int time_out_;
-    std::shared_ptr<eviction_policy> eviction_policy_;
+    // Period an open reuses the attributes checked by a previous one (in seconds)
+    int attr_time_out_;
+    // Blocks evicted from memory are demoted to this directory, unless it is empty
+    std::string disk_directory_;
+    size_t disk_size_;
+    // Expired blocks are served while a pool of workers reads them again
+    bool stale_while_revalidate_;
+    size_t refresh_workers_;
+    // Fractions of the capacity of a shard. Past the high watermark a background thread
+    // evicts in batches down to the low one, misses only evict past the capacity. A high
+    // watermark of 1 leaves the eviction to the misses
+    double high_watermark_;
+    double low_watermark_;
+    // Hot blocks are saved to this file on shutdown and fetched again on the next
+    // mount, at most warm_start_rate_ requests a second. The cache itself ignores both
+    std::string warm_start_manifest_;
+    size_t warm_start_rate_;
+    // Files may be bypassed, pinned or given another time out by the rule of their path
+    std::vector<utils::path_rule> rules_;
+    // An LRU without admission is linked through the blocks themselves
+    eviction_policy eviction_policy_;
+    bool tinylfu_admission_;
+  };
+
+  struct fetch_counters {
+    size_t fetches_;
+    size_t coalesced_;
+    size_t refreshes_;
+    size_t stale_serves_;
   };
 
   cache(config &config, const fuse_operations &operations);
 
+  ~cache();
+
   int open(const char *path, struct fuse_file_info *fi);
 
   int release(const char *path, struct fuse_file_info *fi);
@@ -45,30 +92,287 @@ public:
   int read(const char *path, char *buf, size_t size, off_t offset,
            struct fuse_file_info *fi);
 
+  int write(const char *path, const char *buf, size_t size, off_t offset,
+            struct fuse_file_info *fi);
+
+  int truncate(const char *path, off_t size);
+
+  int ftruncate(const char *path, off_t size, struct fuse_file_info *fi);
+
+  int fallocate(const char *path, int mode, off_t offset, off_t length,
+                struct fuse_file_info *fi);
+
+  [[nodiscard]] size_t size() const;
+
+  [[nodiscard]] block_pool::stats allocator_stats() const;
+
+  [[nodiscard]] fetch_counters fetch_stats() const;
+
+  [[nodiscard]] std::optional<disk_tier::stats> disk_stats() const;
+
+  [[nodiscard]] read_buffer_stats hit_buffer_stats() const;
+
+  // Files with cached blocks, ranked by their most recently cached block, so a later
+  // mount may fetch them again
+  [[nodiscard]] std::vector<utils::manifest_entry> manifest();
+
+  // Blocks evicted by the background reclaimer
+  [[nodiscard]] size_t reclaimed_blocks() const;
+
+  // Resident bytes of the block pools, free buffers included until they are trimmed
+  [[nodiscard]] size_t memory_usage() const override;
+
+  [[nodiscard]] size_t memory_hits() const override;
+
+  // Evicts blocks from every shard in turn, then gives the pages of the free buffers
+  // back to the system. Returns the decrease of memory_usage()
+  size_t shrink(size_t bytes) override;
+
 private:
-  struct block {
-    block(std::unique_ptr<char[]> buf, size_t size, off_t offset, struct timespec &mtime);
+  struct file;
 
-    [[nodiscard]] bool is_valid(int time_out, struct timespec &current_file_mtime) const;
+  struct block : public intrusive_lru_hook {
+    block(file &file, block_pool::buffer buf, size_t size, off_t offset,
+          uint64_t version);
 
-    std::unique_ptr<char[]> buf_;
+    [[nodiscard]] bool is_valid(int time_out, uint64_t current_file_version) const;
+
+    [[nodiscard]] bool is_expired(int time_out) const;
+
+    file &file_;
+    block_pool::buffer buf_;
     size_t size_;
     const off_t offset_;
     std::chrono::high_resolution_clock::time_point timestamp_;
-    struct timespec mtime_;
+    uint64_t version_;
+    std::atomic<bool> refreshing_;
+    std::shared_mutex mtx_;
+  };
+
+  // A block being read from the next layer, concurrent misses wait for its result:
+  // an error, 0 at the end of the file or a positive value to look the block up again
+  struct fetch {
+    static constexpr int retry = 1;
+
+    fetch();
+
+    void complete(int result);
+
+    int wait();
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool done_;
+    int result_;
+    // Set when the file is modified while the block is read, it must not be cached
+    std::atomic<bool> stale_;
+  };
+
+  // Files are interned into small integer ids, so block keys don't carry paths. An entry
+  // outlives its handles while it has blocks, which stay valid while they carry the
+  // current version of the file: the one of its last known identity
+  struct file {
+    file(file_id id, struct stat &stbuf, int time_out, bool pinned);
+
+    void cached_block(size_t block_id);
+
+    [[nodiscard]] bool is_validated(int attr_time_out) const;
+
+    bool revalidate(struct stat &stbuf);
+
+    const file_id id_;
+    // From the rule of the path, pinned blocks are left out of the eviction policy
+    const int time_out_;
+    const bool pinned_;
+    size_t handles_;
+    uint64_t version_;
+    file_identity identity_;
+    off_t size_;
+    bool locally_modified_;
+    // Identity reported by the next layer after the last modification through the
+    // cache, unset when it couldn't be taken
+    std::optional<file_identity> modified_identity_;
+    std::chrono::steady_clock::time_point validated_;
+    std::atomic<size_t> blocks_end_;
+    std::atomic<size_t> n_blocks_;
+    // Guards the updates of the blocks made by the modifications through the cache and
+    // their count. The next layer is called outside of it, so modifications overlapping
+    // in time can't be ordered: they drop the blocks instead of updating them
+    std::mutex write_mtx_;
+    size_t modifying_;
+    uint64_t modifications_;
+    // Background refreshes use the handle of the reader, release waits for them
+    std::atomic<size_t> refreshes_;
+  };
+
+  struct refresh {
+    file *file_;
+    key key_;
+    std::string path_;
+    struct fuse_file_info fi_;
+    uint64_t version_;
+  };
+
+  // LRU linked through the blocks, the key of the victim is computed from its offset
+  class lru_policy
+  {
+  public:
+    explicit lru_policy(size_t block_size);
+
+    void touch(const key &, block &block) { lru_.touch(block); }
+
+    void remove(const key &, block &block) { lru_.remove(block); }
+
+    std::optional<key> evict();
+
+  private:
+    const size_t block_size_;
+    intrusive_lru_manager<block> lru_;
+  };
+
+  template <typename Manager> using managed_policy = common::managed_policy<Manager>;
+
+  using rnd_policy = managed_policy<rnd_cache_manager<key>>;
+  using arc_policy = managed_policy<arc_cache_manager<key>>;
+  using sampled_policy = managed_policy<sampled_cache_manager<key>>;
+  using tinylfu_policy = managed_policy<tinylfu_cache_manager<key>>;
+
+  using policies =
+      std::variant<lru_policy, rnd_policy, arc_policy, sampled_policy, tinylfu_policy>;
+
+  struct shard {
+    shard(const config &config, size_t capacity);
+
+    const size_t capacity_;
+    std::atomic<size_t> size_;
+    block_pool pool_;
+    policies policy_;
+    // Hits are recorded here and replayed on the eviction policy in batches
+    read_buffer<block> hits_;
     std::shared_mutex mtx_;
+    std::unordered_map<key, block, absl::Hash<key>> blocks_;
+    absl::flat_hash_map<key, std::shared_ptr<fetch>> fetches_;
   };
 
-  void remove_block(key &key);
+  static policies make_policy(const config &config);
+
+  shard &shard_of(const key &key);
+
+  [[nodiscard]] key key_of(const block &block) const;
+
+  // Tells the eviction policy of the shard that a block was used, the block must be
+  // kept in place by a lock on the shard
+  void touch_block(shard &shard, const key &key, block &block);
+
+  // Buffers a hit on a block, under the same lock as touch_block
+  void record_hit(shard &shard, block &block);
+
+  // Replays the buffered hits, before the blocks they point to may be removed
+  void drain_hits(shard &shard);
+
+  // Marks a pending fetch of the block stale too when `stale` is set
+  void remove_block(shard &shard, const key &key, bool stale = false);
+
+  void remove_blocks(const file &file);
+
+  // Ids from `first_block_id` on of the blocks of a file cached or being fetched. Every
+  // id up to the end of its blocks is a candidate, unless they are many more than the
+  // blocks cached: then the shards are scanned instead
+  std::vector<size_t> block_ids_of(const file &file, size_t first_block_id);
+
+  // Counts a modification of the file about to reach the next layer, returns how many
+  // were completed before it
+  uint64_t begin_modification(file &file);
+
+  // Under write_mtx_, tells if no other modification of the file overlapped this one
+  bool end_modification(file &file, uint64_t started);
+
+  // Drops the blocks of a range instead of updating them
+  void drop_blocks(file &file, size_t first_block_id, size_t end_block_id);
+
+  // Every cached block of the file is void, its size is taken from the next layer
+  void invalidate(file &file, const char *path);
+
+  void sweep_files();
+
+  file *find_file(const char *path);
+
+  file *acquire_file(const char *path);
+
+  void release_file(const char *path);
+
+  void write_blocks(file &file, const char *buf, size_t size, off_t offset);
+
+  void resize_blocks(file &file, size_t old_size, size_t new_size);
+
+  void resize_block(const key &key, size_t block_size);
+
+  off_t size_of(file &file);
+
+  file_identity identity_of(file &file);
+
+  void modified(file &file, off_t size, bool invalidate = false);
+
+  // Takes the identity of the file once a modification through the cache completed, so
+  // the next open tells it apart from the changes of other clients
+  void record_identity(file &file, const char *path);
+
+  std::optional<int> fetch_blocks(file &file, const key &first_key,
+                                  std::shared_ptr<fetch> first_fetch, size_t end_block_id,
+                                  const char *path, uint64_t version,
+                                  const file_identity &identity,
+                                  struct fuse_file_info *fi);
+
+  void evict_block(shard &shard);
+
+  // Selects up to `count` victims at once and evicts them, returns how many were found
+  size_t evict_blocks(shard &shard, size_t count);
+
+  void reclaimer();
+
+  // Removes the block, writing it to the disk tier first when it is still valid. The
+  // write is made without locks, with a pending fetch standing in for the block
+  void demote_block(shard &shard, const key &key);
+
+  void complete_fetch(shard &shard, const key &key, fetch &fetch, int result);
+
+  void schedule_refresh(file &file, const key &key, const char *path,
+                        struct fuse_file_info *fi, uint64_t version);
+
+  void refresh_worker();
+
+  void refresh_block(const refresh &refresh);
 
   const config config_;
   const fuse_operations &operations_;
+  const utils::path_rules rules_;
+
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::unique_ptr<disk_tier> disk_;
+  std::shared_mutex files_mtx_;
+  absl::node_hash_map<std::string, file> files_;
+  file_id next_file_id_;
+  size_t sweep_threshold_;
+
+  std::mutex refresh_mtx_;
+  std::condition_variable refresh_cv_;
+  std::deque<refresh> refresh_queue_;
+  bool stop_refresh_;
+  std::vector<std::thread> refresh_workers_;
+
+  // Watermarks of every shard (in bytes)
+  size_t high_watermark_;
+  size_t low_watermark_;
+  std::mutex reclaim_mtx_;
+  std::condition_variable reclaim_cv_;
+  bool stop_reclaim_;
+  std::thread reclaimer_;
 
-  std::atomic<size_t> cache_size_;
-  std::shared_mutex cache_mtx_;
-  std::unordered_map<key, block, absl::Hash<key>> cache_;
-  std::mutex mtimes_mtx_;
-  std::unordered_map<std::string, struct timespec> mtimes_;
+  std::atomic<size_t> n_fetches_;
+  std::atomic<size_t> n_coalesced_;
+  std::atomic<size_t> n_refreshes_;
+  std::atomic<size_t> n_stale_serves_;
+  std::atomic<size_t> n_reclaimed_;
 };
 
-} // namespace rsafefs::data_cache
\ No newline at end of file
+} // namespace rsafefs::data_cache
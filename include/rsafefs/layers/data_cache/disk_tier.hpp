@@ -0,0 +1,108 @@
+#pragma once
+
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include <absl/container/flat_hash_map.h>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace rsafefs::data_cache
+{
+
+// Attributes of a file when its blocks were cached, blocks of another identity are stale
+struct file_identity {
+  file_identity() = default;
+
+  explicit file_identity(const struct stat &stbuf);
+
+  bool operator==(const file_identity &other) const;
+
+  ino_t ino_;
+  struct timespec mtime_;
+  struct timespec ctime_;
+  off_t size_;
+};
+
+// Second level of the data cache: blocks evicted from memory are kept in a preallocated
+// file of fixed-size slots. The index is saved next to it on a clean shutdown and loaded
+// back on start, so it is keyed by inode instead of by the ids interned for a mount
+class disk_tier
+{
+public:
+  struct stats {
+    size_t capacity_;
+    size_t used_;
+    size_t hits_;
+    size_t misses_;
+    size_t demotions_;
+  };
+
+  disk_tier(const std::string &directory, size_t size, size_t block_size);
+
+  ~disk_tier();
+
+  disk_tier(const disk_tier &) = delete;
+
+  disk_tier &operator=(const disk_tier &) = delete;
+
+  [[nodiscard]] bool contains(const file_identity &identity, size_t block_id);
+
+  // Copies the block into buf and returns its size, nothing when it isn't stored
+  std::optional<size_t> get(const file_identity &identity, size_t block_id, char *buf);
+
+  void put(const file_identity &identity, size_t block_id, const char *buf, size_t size);
+
+  // Drops the blocks [first_block_id, end_block_id) of a file
+  void remove(ino_t ino, size_t first_block_id,
+              size_t end_block_id = std::numeric_limits<size_t>::max());
+
+  [[nodiscard]] stats get_stats();
+
+private:
+  using block_key = std::pair<ino_t, size_t>;
+
+  struct slot {
+    size_t slot_;
+    size_t size_;
+  };
+
+  struct file {
+    file_identity identity_;
+    absl::flat_hash_map<size_t, slot> blocks_;
+  };
+
+  void drop_block(file &file, ino_t ino, size_t block_id);
+
+  void drop_file(ino_t ino);
+
+  std::optional<size_t> allocate_slot();
+
+  void load_index();
+
+  void save_index();
+
+  const std::string blocks_path_;
+  const std::string index_path_;
+  const size_t block_size_;
+  const size_t n_slots_;
+  int fd_;
+
+  std::mutex mtx_;
+  absl::flat_hash_map<ino_t, file> files_;
+  std::vector<size_t> free_slots_;
+  // Bumped every time a slot is handed out, readers check it didn't change under them
+  std::vector<uint64_t> generations_;
+  lru_cache_manager<block_key> eviction_policy_;
+
+  std::atomic<size_t> n_hits_;
+  std::atomic<size_t> n_misses_;
+  std::atomic<size_t> n_demotions_;
+};
+
+} // namespace rsafefs::data_cache
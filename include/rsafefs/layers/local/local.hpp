@@ -23,6 +23,7 @@ private:
   enum mode { LOCAL, NFS };
   std::string path_;
   mode mode_;
+  bool readdir_plus_;
 
 public:
   local_config(YAML::Node data);
@@ -6,6 +6,8 @@
 namespace rsafefs
 {
 
-void assign_nfs_operations(fuse_operations &operations, const std::string &path);
+// With readdir_plus, readdir fills the full attributes of every entry
+void assign_nfs_operations(fuse_operations &operations, const std::string &path,
+                           bool readdir_plus = false);
 
 }
\ No newline at end of file
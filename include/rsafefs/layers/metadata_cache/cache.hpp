@@ -1,40 +1,72 @@
 #pragma once
 
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/cache.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "rsafefs/common/cache/tinylfu_manager.hpp"
+#include "rsafefs/fuse_rpc/utils/dir_info.hpp"
 #include "rsafefs/fuse_wrapper/fuse31.hpp"
-#include <atomic>
+#include "rsafefs/utils/memory_governor.hpp"
+#include "rsafefs/utils/path_rules.hpp"
+#include "rsafefs/utils/warm_start.hpp"
+#include <absl/container/flat_hash_map.h>
 #include <chrono>
-#include <condition_variable>
-#include <optional>
-#include <random>
+#include <memory>
 #include <shared_mutex>
+#include <string>
 #include <sys/stat.h>
-#include <thread>
-#include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace rsafefs::metadata_cache
 {
 using key = std::string;
 
-class cache
+// Instantiation of the generic cache for attributes, one per eviction policy. The policy
+// is picked at runtime, so every operation goes through a single visit of the variant.
+// Paths are spread over independently locked shards, each one with its own engine
+class cache : public utils::memory_consumer
 {
 public:
-  class eviction_policy
-  {
-  public:
-    virtual ~eviction_policy() = default;
-
-  private:
-    virtual void touch(const key &key) = 0;
-    virtual void remove(const key &key) = 0;
-    virtual std::optional<key> evict() = 0;
-
-    friend class metadata_cache::cache;
-  };
+  enum class eviction_policy { lru, rnd, arc, sampled };
 
   struct config {
     size_t size_;
+    // Each shard holds size_ / shards_ entries and evicts on its own
+    size_t shards_;
     int time_out_;
-    std::shared_ptr<eviction_policy> eviction_policy_;
+    eviction_policy eviction_policy_;
+    bool tinylfu_admission_;
+    // Cached paths are saved to this file on shutdown and fetched again on the next
+    // mount, at most warm_start_rate_ a second. The cache itself ignores both
+    std::string warm_start_manifest_;
+    size_t warm_start_rate_;
+    // Paths may be bypassed, pinned or given another time out by their rule
+    std::vector<utils::path_rule> rules_;
+    // Entries of the paths that don't exist, kept apart from the attributes and valid
+    // for negative_time_out_ seconds. With a negative_size_ of 0 none are kept
+    size_t negative_size_;
+    int negative_time_out_;
+    // Directory listings, up to dir_size_ entries of all of them together. They are
+    // kept apart from the shards, so a single listing may take the whole budget. With 0
+    // none are kept
+    size_t dir_size_;
+    // The layers below fill the full attributes of the entries listed by readdir, which
+    // are cached as if fetched by getattr. The cache itself ignores it
+    bool readdir_plus_;
+    // The attributes of the children of a listed directory are fetched in bulk in the
+    // background, when a layer below batches them. The cache itself ignores it
+    bool prefetch_children_;
+  };
+
+  // Entries of a directory as returned by readdir, with the mtime it had before
+  struct listing {
+    std::vector<DirInfo::Entry> entries_;
+    // Index of the entry following the one with an offset, where a readdir resumes
+    absl::flat_hash_map<off_t, size_t> next_;
+    struct timespec mtime_;
   };
 
   cache(config &config);
@@ -43,22 +75,144 @@ public:
 
   bool get(const std::string &path, struct stat *stbuf);
 
+  // Also forgets that the path doesn't exist
   void remove(const std::string &path);
 
+  // Remembers that a path doesn't exist
+  void put_negative(const std::string &path);
+
+  // Whether a path is known not to exist
+  bool get_negative(const std::string &path);
+
+  // Forgets that a path doesn't exist, keeping its attributes
+  void remove_negative(const std::string &path);
+
+  // Forgets that the paths under a directory don't exist, for a directory moved there
+  void remove_negatives_under(const std::string &path);
+
+  // Listings with more entries than dir_size_ aren't kept
+  void put_listing(const std::string &path, std::shared_ptr<const listing> listing);
+
+  // The listing of a directory, nullptr when it isn't cached or it expired
+  [[nodiscard]] std::shared_ptr<const listing> get_listing(const std::string &path);
+
+  [[nodiscard]] read_buffer_stats hit_buffer_stats() const;
+
+  // Cached paths, the most recently fetched first
+  [[nodiscard]] std::vector<utils::manifest_entry> manifest() const;
+
+  // Pinned entries are left out, they can't be shrunk
+  [[nodiscard]] size_t memory_usage() const override;
+
+  [[nodiscard]] size_t memory_hits() const override;
+
+  size_t shrink(size_t bytes) override;
+
 private:
   struct metadata {
-    metadata(struct stat *stbuf);
+    metadata() = default;
 
-    [[nodiscard]] bool is_valid(int time_out) const;
+    metadata(struct stat *stbuf, int time_out);
+
+    [[nodiscard]] bool is_valid() const;
 
     struct stat stbuf_;
     std::chrono::high_resolution_clock::time_point timestamp_;
+    int time_out_;
+  };
+
+  struct negative {
+    explicit negative(int time_out);
+
+    [[nodiscard]] bool is_valid() const;
+
+    std::chrono::high_resolution_clock::time_point timestamp_;
+    int time_out_;
+  };
+
+  struct cached_listing {
+    cached_listing(std::shared_ptr<const listing> listing, int time_out);
+
+    [[nodiscard]] bool is_valid() const;
+
+    std::shared_ptr<const listing> listing_;
+    std::chrono::high_resolution_clock::time_point timestamp_;
+    int time_out_;
+  };
+
+  // A listing takes a unit for each entry, plus one for the directory itself
+  struct listing_size {
+    size_t operator()(const cached_listing &cached) const
+    {
+      return cached.listing_->entries_.size() + 1;
+    }
   };
 
-  const config config_;
+  struct is_fresh {
+    template <typename Value> bool operator()(const Value &value) const
+    {
+      return value.is_valid();
+    }
+  };
+
+  template <typename Policy>
+  using engine =
+      common::cache<key, metadata, Policy, common::unit_size<metadata>, is_fresh>;
+
+  template <typename Manager>
+  using managed_engine = engine<common::managed_policy<Manager>>;
+
+  using lru_engine = engine<common::intrusive_lru_policy<key, metadata>>;
+  using rnd_engine = managed_engine<rnd_cache_manager<key>>;
+  using arc_engine = managed_engine<arc_cache_manager<key>>;
+  using sampled_engine = managed_engine<sampled_cache_manager<key>>;
+  using tinylfu_engine = managed_engine<tinylfu_cache_manager<key>>;
+
+  using engines =
+      std::variant<lru_engine, rnd_engine, arc_engine, sampled_engine, tinylfu_engine>;
+
+  using negative_engine =
+      common::cache<key, negative, common::intrusive_lru_policy<key, negative>,
+                    common::unit_size<negative>, is_fresh>;
+
+  using listing_policy = common::intrusive_lru_policy<key, cached_listing>;
+  using listing_engine =
+      common::cache<key, cached_listing, listing_policy, listing_size, is_fresh>;
+
+  struct shard {
+    shard(const config &config, size_t capacity, size_t negative_capacity);
+
+    engines engine_;
+    negative_engine negatives_;
+  };
 
-  std::unordered_map<key, metadata> cache_;
-  std::shared_mutex mtx_;
+  static engines make_engine(const config &config, size_t capacity);
+
+  [[nodiscard]] shard &shard_of(const key &path) const;
+
+  // Shrinks every shard by its share of `amount` units, with shrink_shard(shard, units),
+  // until the units add up to `amount` or no shard has any left
+  template <typename F> size_t shrink_shards(size_t amount, F &&shrink_shard);
+
+  // Estimate of the memory taken by an entry, its node in the map and a short path
+  static constexpr size_t entry_bytes =
+      sizeof(common::cache_entry<key, metadata>) + sizeof(key) + 64;
+  static constexpr size_t negative_entry_bytes =
+      sizeof(common::cache_entry<key, negative>) + sizeof(key) + 64;
+  static constexpr size_t listing_entry_bytes =
+      sizeof(DirInfo::Entry) + sizeof(std::pair<off_t, size_t>) + 32;
+
+  std::vector<std::unique_ptr<shard>> shards_;
+  const int time_out_;
+  const bool negative_enabled_;
+  const int negative_time_out_;
+  const size_t listing_capacity_;
+  // Listings are few and large, one store holds all of them
+  listing_engine listings_;
+  const utils::path_rules rules_;
+  // Entries of the pinned paths, out of the reach of the eviction policy
+  mutable std::shared_mutex pinned_mtx_;
+  absl::flat_hash_map<key, metadata> pinned_;
 };
 
-} // namespace rsafefs::metadata_cache
\ No newline at end of file
+} // namespace rsafefs::metadata_cache
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "rsafefs/layers/metadata_cache/cache.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rsafefs::metadata_cache
+{
+
+// Fetches the attributes of the children of listed directories in bulk, through a layer
+// below that batches them (see utils::bulk_getattr), in a thread of its own so readdir
+// doesn't wait for it. Directories listed while too many are pending are skipped. The
+// attributes of a batch that overlapped a mutation under its directory aren't cached
+class children_prefetcher
+{
+public:
+  // Paths fetched by a single bulk request
+  static constexpr size_t batch = 1024;
+  // Directories waiting to be prefetched at most
+  static constexpr size_t max_pending = 64;
+
+  // What a mutation changes besides the contents of files
+  enum class scope {
+    entry,     // attributes of the entry at the path
+    directory, // also the ones of its directory, which gains or loses an entry
+    entries,   // entries of the directory at the path
+  };
+
+  // Marks a mutation of `path` while it lives. Without a prefetcher it does nothing
+  class mutation
+  {
+  public:
+    mutation(children_prefetcher *prefetcher, const char *path,
+             scope what = scope::entry);
+
+    ~mutation();
+
+    mutation(const mutation &) = delete;
+
+    mutation &operator=(const mutation &) = delete;
+
+  private:
+    children_prefetcher *prefetcher_;
+    // Directories whose prefetched entries the mutation changes
+    std::vector<std::string> dirs_;
+  };
+
+  explicit children_prefetcher(cache &cache);
+
+  // Queued directories are dropped, the one being prefetched is finished first
+  ~children_prefetcher();
+
+  children_prefetcher(const children_prefetcher &) = delete;
+
+  children_prefetcher &operator=(const children_prefetcher &) = delete;
+
+  // Queues the children of `dir`, given by their names
+  void schedule(const std::string &dir, std::vector<std::string> names);
+
+  // Waits for the queued directories to be prefetched
+  void drain();
+
+private:
+  struct job {
+    std::string dir_;
+    std::vector<std::string> names_;
+  };
+
+  // Mutations of the entries of the directories hashed into it, the ones in progress
+  // and the ones completed so far
+  struct slot {
+    std::mutex mtx_;
+    size_t in_progress_;
+    uint64_t completed_;
+  };
+
+  static constexpr size_t n_slots = 64;
+
+  slot &slot_of(const std::string &dir);
+
+  void run();
+
+  void prefetch(const job &job);
+
+  cache &cache_;
+  std::array<slot, n_slots> slots_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  std::deque<job> queue_;
+  bool busy_;
+  bool stop_;
+  std::thread thread_;
+};
+
+} // namespace rsafefs::metadata_cache
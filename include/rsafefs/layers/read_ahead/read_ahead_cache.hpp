@@ -1,6 +1,8 @@
 #pragma once
 
 #include "rsafefs/fuse_wrapper/fuse31.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <mutex>
@@ -10,7 +12,7 @@
 namespace rsafefs::read_ahead
 {
 
-class cache
+class cache : public utils::memory_consumer
 {
 public:
   struct config {
@@ -26,15 +28,27 @@ public:
 
   int release(const char *path, struct fuse_file_info *fi);
 
+  [[nodiscard]] size_t memory_usage() const override;
+
+  [[nodiscard]] size_t memory_hits() const override;
+
+  // Drops the contents of buffers, they are filled again by the next read
+  size_t shrink(size_t bytes) override;
+
 private:
   struct buffer {
     buffer();
 
     int read(char *buf, size_t size, off_t offset);
 
-    void update(size_t size, off_t offset, std::unique_ptr<char[]> buf);
+    // Returns the capacity of the replaced buffer
+    size_t update(size_t size, off_t offset, std::unique_ptr<char[]> buf,
+                  size_t capacity);
+
+    size_t clear();
 
     size_t size_;
+    size_t capacity_;
     off_t offset_;
     std::unique_ptr<char[]> buf_;
     std::shared_mutex mtx_;
@@ -45,6 +59,9 @@ private:
 
   std::unordered_map<std::string, buffer> buffers_;
   std::shared_mutex mtx_;
+  // Bytes allocated by the buffers
+  std::atomic<size_t> memory_;
+  std::atomic<size_t> n_hits_;
 };
 
 } // namespace rsafefs::read_ahead
\ No newline at end of file
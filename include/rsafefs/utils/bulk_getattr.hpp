@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+namespace rsafefs::utils
+{
+
+// Process wide hook to fetch the attributes of several paths at once. FUSE has no such
+// operation, so the layer able to batch them, as the rpc client, provides it and the
+// layers above, as the metadata cache, fetch through it instead of one getattr per path
+class bulk_getattr
+{
+public:
+  // Attributes of the paths found. The paths missing from it either don't exist, then
+  // they are listed apart, or failed their getattr otherwise
+  using attributes = std::vector<std::pair<std::string, struct stat>>;
+
+  using fetcher = std::function<int(const std::vector<std::string> &paths,
+                                    attributes &found,
+                                    std::vector<std::string> &missing)>;
+
+  static bulk_getattr &instance();
+
+  bulk_getattr(const bulk_getattr &) = delete;
+
+  bulk_getattr &operator=(const bulk_getattr &) = delete;
+
+  void provide(fetcher fetcher);
+
+  void withdraw();
+
+  [[nodiscard]] bool available() const;
+
+  // Returns -ENOSYS when no layer provides it
+  int fetch(const std::vector<std::string> &paths, attributes &found,
+            std::vector<std::string> &missing) const;
+
+private:
+  bulk_getattr() = default;
+
+  mutable std::shared_mutex mtx_;
+  fetcher fetcher_;
+};
+
+} // namespace rsafefs::utils
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rsafefs::utils
+{
+
+// Something that holds memory on behalf of a layer and can give part of it back
+class memory_consumer
+{
+public:
+  virtual ~memory_consumer() = default;
+
+  // Bytes held right now
+  [[nodiscard]] virtual size_t memory_usage() const = 0;
+
+  // Requests served from that memory so far, the benefit of keeping it
+  [[nodiscard]] virtual size_t memory_hits() const = 0;
+
+  // Gives back about `bytes` bytes, returns how many were released
+  virtual size_t shrink(size_t bytes) = 0;
+};
+
+// Process wide memory budget shared by the layers. Each cache registers itself, and
+// whenever the sum of their usage exceeds the budget the governor asks them to shrink,
+// starting with the one that served the fewest hits per byte since the last time it
+// was balanced. A budget of 0 leaves every layer to its own size. Under memory pressure
+// a lower limit may be set on top of the budget for a while
+class memory_governor
+{
+public:
+  struct usage {
+    std::string name_;
+    const memory_consumer *consumer_;
+    size_t bytes_;
+    size_t hits_;
+    // Bytes given back at the request of the governor
+    size_t shrunk_;
+  };
+
+  static memory_governor &instance();
+
+  memory_governor(const memory_governor &) = delete;
+
+  memory_governor &operator=(const memory_governor &) = delete;
+
+  void set_budget(size_t budget);
+
+  [[nodiscard]] size_t budget() const;
+
+  // Temporary limit below the budget, 0 lifts it
+  void set_pressure_limit(size_t limit);
+
+  [[nodiscard]] size_t pressure_limit() const;
+
+  // Bytes held by all the consumers
+  [[nodiscard]] size_t total_usage() const;
+
+  void add(const std::string &name, memory_consumer *consumer);
+
+  // Logs the usage of the consumer over its lifetime, as when its layer is unmounted
+  void remove(memory_consumer *consumer);
+
+  // Shrinks the consumers until they fit in the budget and the pressure limit. They
+  // shrink under their own locks, so it must be called without holding any of them.
+  // When they shrink, the usage of each one is logged
+  void balance();
+
+  // Balances at most once per balance_period, for the hot paths of the layers. Between
+  // two balances it only loads a couple of atomics
+  void balance_if_due();
+
+  // Usage of each registered consumer
+  [[nodiscard]] std::vector<usage> breakdown() const;
+
+  // Shortest period between the balances of balance_if_due
+  static constexpr std::chrono::milliseconds balance_period{50};
+
+private:
+  struct entry {
+    std::string name_;
+    memory_consumer *consumer_;
+    // Hits of the consumer when it was last balanced
+    size_t balanced_hits_;
+    size_t shrunk_;
+  };
+
+  memory_governor();
+
+  // Same as breakdown(), with mtx_ already held
+  [[nodiscard]] std::vector<usage> breakdown_locked() const;
+
+  static void log_usage(const usage &usage);
+
+  std::atomic<size_t> budget_;
+  std::atomic<size_t> pressure_limit_;
+  // Steady clock time, in nanoseconds, after which balance_if_due balances again
+  std::atomic<int64_t> next_balance_;
+  std::vector<entry> entries_;
+  mutable std::mutex mtx_;
+};
+
+} // namespace rsafefs::utils
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "rsafefs/utils/memory_governor.hpp"
+#include "yaml-cpp/yaml.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace rsafefs::utils
+{
+
+// Watches the memory of the cgroup (v2) of the process and makes the caches give memory
+// back before the container is killed. Every interval it reads memory.current,
+// memory.max and the PSI of memory.pressure. While one of them is over its threshold the
+// governor gets a pressure limit below what the caches hold, so the ones worth the least
+// shrink first. Once the pressure is gone the limit is raised step by step and then
+// lifted, letting the caches grow back
+class memory_pressure_monitor
+{
+public:
+  struct config {
+    std::string cgroup_directory_;
+    std::chrono::milliseconds interval_;
+    // Fraction of memory.max in use considered pressure
+    double usage_threshold_;
+    // Share of the last 10 seconds with some task stalled on memory (in percent)
+    double pressure_threshold_;
+    // Fraction of the cached memory given back on every check under pressure, and by
+    // which the limit grows on every check without it
+    double shrink_ratio_;
+  };
+
+  struct sample {
+    size_t current_;
+    // Unset when the cgroup has no limit
+    std::optional<size_t> max_;
+    double pressure_;
+  };
+
+  // Reads the configuration of the `memory_pressure` key, throws wrong_config_exception
+  static config parse_config(const YAML::Node &data);
+
+  memory_pressure_monitor(const config &config, memory_governor &governor);
+
+  ~memory_pressure_monitor();
+
+  memory_pressure_monitor(const memory_pressure_monitor &) = delete;
+
+  memory_pressure_monitor &operator=(const memory_pressure_monitor &) = delete;
+
+  // Checks the cgroup every interval in a thread of its own
+  void start();
+
+  void stop();
+
+  // A single check, returns false when the cgroup files can't be read
+  bool check();
+
+  [[nodiscard]] std::optional<sample> read_sample() const;
+
+  [[nodiscard]] bool is_under_pressure(const sample &sample) const;
+
+private:
+  void run();
+
+  const config config_;
+  memory_governor &governor_;
+
+  std::thread thread_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_;
+};
+
+} // namespace rsafefs::utils
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "yaml-cpp/yaml.h"
+#include <absl/container/flat_hash_map.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rsafefs::utils
+{
+
+// How a cache treats the paths matched by a pattern. A pattern without wildcards is a
+// prefix: it matches the path itself and everything under it. Otherwise it is matched
+// against the whole path with fnmatch(3), where `*` also crosses `/`
+struct path_rule {
+  std::string pattern_;
+  // Replaces the time out of the cache (in seconds), 0 never expires
+  std::optional<int> time_out_;
+  // Pinned entries are never evicted, bypassed ones are never cached
+  bool pin_;
+  bool bypass_;
+  // Among the rules matching a path the highest priority wins, then the longest prefix
+  int priority_;
+};
+
+// Reads a `rules` list of a cache, throws wrong_config_exception
+std::vector<path_rule> parse_path_rules(const YAML::Node &data);
+
+// Rules compiled into a trie of path components. Only the literal leading components of
+// a pattern are in the trie, so a lookup walks the path once and fnmatch only runs for
+// the wildcard rules found along the way
+class path_rules
+{
+public:
+  path_rules() = default;
+
+  explicit path_rules(std::vector<path_rule> rules);
+
+  // The rule applying to an absolute path, nullptr when none does
+  [[nodiscard]] const path_rule *match(std::string_view path) const
+  {
+    return rules_.empty() ? nullptr : lookup(path);
+  }
+
+  [[nodiscard]] bool empty() const { return rules_.empty(); }
+
+private:
+  struct node {
+    absl::flat_hash_map<std::string, size_t> children_;
+    // Indexes of the rules, the highest priority first
+    std::vector<size_t> prefixes_;
+    std::vector<size_t> globs_;
+  };
+
+  [[nodiscard]] const path_rule *lookup(std::string_view path) const;
+
+  std::vector<path_rule> rules_;
+  std::vector<node> nodes_;
+};
+
+} // namespace rsafefs::utils
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+namespace rsafefs::utils
+{
+
+// What a cache held for a path when it was shut down, so a new mount may fetch it again
+struct manifest_entry {
+  std::string path_;
+  // Modification time and size of the file, entries of a file that changed are skipped
+  struct timespec mtime_;
+  off_t size_;
+  // Cached blocks of the file, the most recently fetched first. Empty for attributes
+  std::vector<uint64_t> blocks_;
+};
+
+struct timespec mtime_of(const struct stat &stbuf);
+
+// Whether the file still has the modification time and size of the entry
+bool is_unchanged(const manifest_entry &entry, const struct stat &stbuf);
+
+// Writes the entries, the hottest first, replacing the manifest only once it is complete
+bool save_manifest(const std::string &manifest_path,
+                   const std::vector<manifest_entry> &entries);
+
+// Entries of a manifest in the order they were saved, none when it is missing or invalid
+std::vector<manifest_entry> load_manifest(const std::string &manifest_path);
+
+// Replays the entries of a manifest in a thread of its own. The replay function paces
+// itself through pace(), so the next layers see at most `rate` fetches a second
+class warm_start_prefetcher
+{
+public:
+  using replay_fn =
+      std::function<void(const manifest_entry &entry, warm_start_prefetcher &prefetcher)>;
+
+  warm_start_prefetcher(std::vector<manifest_entry> entries, size_t rate,
+                        replay_fn replay);
+
+  ~warm_start_prefetcher();
+
+  warm_start_prefetcher(const warm_start_prefetcher &) = delete;
+
+  warm_start_prefetcher &operator=(const warm_start_prefetcher &) = delete;
+
+  void start();
+
+  // Interrupts the replay, the entry being replayed is left halfway
+  void stop();
+
+  // Waits for the replay to go through every entry
+  void join();
+
+  // Waits for the turn of the next fetch, false once the prefetcher is stopped
+  bool pace();
+
+  // Fetches allowed by pace() so far
+  [[nodiscard]] size_t paced() const;
+
+private:
+  void run();
+
+  const std::vector<manifest_entry> entries_;
+  const std::chrono::nanoseconds period_;
+  const replay_fn replay_;
+
+  std::thread thread_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_;
+  std::chrono::steady_clock::time_point next_;
+  size_t n_paced_;
+};
+
+} // namespace rsafefs::utils
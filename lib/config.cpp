@@ -6,11 +6,35 @@
 #include "rsafefs/layers/rpc_client/rpc_client.hpp"
 #include "rsafefs/server.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
+#include "rsafefs/utils/memory_pressure.hpp"
 #include "rsafefs/utils/utils.hpp"
 
 namespace rsafefs
 {
 
+static fuse_operations monitored_layers;
+static std::unique_ptr<utils::memory_pressure_monitor> pressure_monitor;
+
+static void *
+memory_pressure_init(fuse_conn_info *conn)
+{
+  pressure_monitor->start();
+  if (monitored_layers.init != nullptr) {
+    return monitored_layers.init(conn);
+  }
+  return nullptr;
+}
+
+static void
+memory_pressure_destroy(void *private_data)
+{
+  pressure_monitor->stop();
+  if (monitored_layers.destroy != nullptr) {
+    monitored_layers.destroy(private_data);
+  }
+}
+
 std::unique_ptr<config>
 config::make(std::string &config_file_path, bool debug)
 {
@@ -38,12 +62,19 @@ config::config(std::string &config_file_path)
   }
 
   memset(&operations_, 0, sizeof(operations_));
+  std::optional<utils::memory_pressure_monitor::config> pressure_config;
 
   for (const auto &kv : config) {
     const std::string &layer = kv.first.as<std::string>();
     const YAML::Node &layer_config = kv.second;
 
-    if (layer == "data_cache") {
+    if (layer == "memory_budget") {
+      // Not a layer: bytes shared by the caches of every layer, 0 for no budget
+      utils::memory_governor::instance().set_budget(layer_config.as<size_t>());
+    } else if (layer == "memory_pressure") {
+      // Not a layer either: shrinks the caches when the cgroup runs short of memory
+      pressure_config = utils::memory_pressure_monitor::parse_config(layer_config);
+    } else if (layer == "data_cache") {
       layers_.push_back(std::make_unique<data_cache_config>(layer_config));
     } else if (layer == "local") {
       layers_.push_back(std::make_unique<local_config>(layer_config));
@@ -64,6 +95,15 @@ config::config(std::string &config_file_path)
   for (auto &layer : layers_) {
     layer->init_layer(operations_);
   }
+
+  // The monitor runs on top of the stack, from the mount until the unmount
+  if (pressure_config) {
+    pressure_monitor = std::make_unique<utils::memory_pressure_monitor>(
+        pressure_config.value(), utils::memory_governor::instance());
+    monitored_layers = operations_;
+    operations_.init = memory_pressure_init;
+    operations_.destroy = memory_pressure_destroy;
+  }
 }
 
 config::~config()
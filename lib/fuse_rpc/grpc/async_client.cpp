@@ -81,6 +81,36 @@ async_client::fsync(const char *path, int isdatasync, struct fuse_file_info *fi)
   return sync_client::fsync(path, isdatasync, fi);
 }
 
+size_t
+async_client::memory_usage() const
+{
+  return cache_size_;
+}
+
+size_t
+async_client::memory_hits() const
+{
+  return 0;
+}
+
+size_t
+async_client::shrink([[maybe_unused]] size_t bytes)
+{
+  std::unique_lock lock(mtx_blocks_);
+  if (blocks_queue_size_ == 0) {
+    return 0;
+  }
+  const size_t before = cache_size_;
+  std::future<bool> flushed = schedule_flush();
+  lock.unlock();
+
+  // Only the blocks actually sent are given back, writes made meanwhile may even
+  // have grown the queue
+  flushed.wait();
+  const size_t after = cache_size_;
+  return before > after ? before - after : 0;
+}
+
 void
 async_client::async_complete(CompletionQueue &cq)
 {
@@ -2,6 +2,7 @@
 #include "rsafefs/fuse_rpc/grpc/server.hpp"
 #include "rsafefs/fuse_rpc/grpc/structs_fillers.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include <cerrno>
 #include <grpcpp/server_builder.h>
 
 #ifdef __APPLE__
@@ -96,6 +97,7 @@ server::run()
       new getxattr_data(service_, cq.get(), operations_);
       new listxattr_data(service_, cq.get(), operations_);
       new removexattr_data(service_, cq.get(), operations_);
+      new getattr_compound_data(service_, cq.get(), operations_);
 
       new stream_read_data(service_, cq.get(), operations_);
       new stream_write_data(service_, cq.get(), operations_);
@@ -1280,6 +1282,48 @@ server::removexattr_data::proceed([[maybe_unused]] bool ok)
   }
 }
 
+server::getattr_compound_data::getattr_compound_data(Service &service,
+                                                     ServerCompletionQueue *cq,
+                                                     const fuse_operations &operations)
+    : unary_call_data(service, cq, operations)
+    , responder_(&srv_ctx_)
+{
+  service_.RequestGetattrCompound(&srv_ctx_, &request_, &responder_, cq_, cq_, this);
+}
+
+void
+server::getattr_compound_data::proceed([[maybe_unused]] bool ok)
+{
+  switch (call_status_) {
+  case PROCESS: {
+    new getattr_compound_data(service_, cq_, operations_);
+
+    auto &compound = *reply_.mutable_compound();
+    for (const std::string &path : request_.paths()) {
+      struct stat stbuf {
+      };
+
+      const int res = operations_.getattr(path.c_str(), &stbuf);
+
+      // Paths failing for another reason are left out of both
+      if (res == 0) {
+        fill_StructStat(&compound[path], stbuf);
+      } else if (res == -ENOENT) {
+        reply_.add_removed_paths(path);
+      }
+    }
+
+    call_status_ = FINISHED;
+    responder_.Finish(reply_, Status::OK, this);
+    break;
+  }
+  default: {
+    GPR_ASSERT(call_status_ == FINISHED);
+    delete this;
+  }
+  }
+}
+
 server::stream_read_data::stream_read_data(Service &service, ServerCompletionQueue *cq,
                                            const fuse_operations &operations)
     : bidi_stream_call_data(service, cq, operations)
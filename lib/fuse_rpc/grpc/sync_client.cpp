@@ -814,6 +814,41 @@ sync_client::removexattr(const char *path, const char *name)
   return reply.result();
 }
 
+int
+sync_client::getattr_compound(
+    const std::vector<std::string> &paths,
+    std::vector<std::pair<std::string, struct stat>> &attributes,
+    std::vector<std::string> &missing)
+{
+  fuse_grpc_proto::GetattrCompoundRequest request;
+  fuse_grpc_proto::GetattrCompoundReply reply;
+  ClientContext context;
+
+  for (const std::string &path : paths) {
+    request.add_paths(path);
+  }
+
+  const Status status = stub_->GetattrCompound(&context, request, &reply);
+
+  if (!status.ok()) {
+    logging::critical("[getattr_compound] [{}] paths: {}", status.error_message(),
+                      paths.size());
+    return -1;
+  }
+
+  attributes.reserve(attributes.size() + reply.compound_size());
+  for (const auto &[path, proto_stbuf] : reply.compound()) {
+    struct stat stbuf {
+    };
+    fill_struct_stat(&stbuf, proto_stbuf);
+    attributes.emplace_back(path, stbuf);
+  }
+  missing.insert(missing.end(), reply.removed_paths().begin(),
+                 reply.removed_paths().end());
+
+  return 0;
+}
+
 void
 sync_client::create_streams(const std::string &path, int flags)
 {
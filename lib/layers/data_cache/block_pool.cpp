@@ -0,0 +1,198 @@
+#include "rsafefs/layers/data_cache/block_pool.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace rsafefs
+{
+
+static constexpr size_t hugepage_size = 2UL * 1024UL * 1024UL; // 2 MiB
+
+data_cache::block_pool::block_pool(size_t n_blocks, size_t block_size, bool hugepages)
+    : n_blocks_(n_blocks)
+    , block_size_(block_size)
+    , arena_size_(n_blocks * block_size)
+    , arena_(nullptr)
+    , hugepages_(false)
+    , peak_used_(0)
+    , failed_allocations_(0)
+{
+  void *arena = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (hugepages) {
+    // Explicit hugepages need to be reserved by the administrator, fallback otherwise
+    const size_t hugepages_arena_size =
+        (arena_size_ + hugepage_size - 1) / hugepage_size * hugepage_size;
+    arena = mmap(nullptr, hugepages_arena_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (arena != MAP_FAILED) {
+      arena_size_ = hugepages_arena_size;
+      hugepages_ = true;
+    } else {
+      logging::warn("data cache: no hugepages available for the block pool ({})",
+                    std::strerror(errno));
+    }
+  }
+#endif
+
+  if (arena == MAP_FAILED) {
+    arena = mmap(nullptr, arena_size_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(),
+                              "data cache: unable to map the block pool");
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugepages) {
+      madvise(arena, arena_size_, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  arena_ = static_cast<char *>(arena);
+
+  // Hand out the blocks from the beginning of the arena first
+  free_list_.reserve(n_blocks_);
+  cold_list_.reserve(n_blocks_);
+  for (size_t i = n_blocks_; i > 0; i--) {
+    cold_list_.push_back(arena_ + (i - 1) * block_size);
+  }
+}
+
+data_cache::block_pool::~block_pool() { munmap(arena_, arena_size_); }
+
+data_cache::block_pool::buffer
+data_cache::block_pool::allocate()
+{
+  std::unique_lock lock(mtx_);
+  std::vector<char *> &list = free_list_.empty() ? cold_list_ : free_list_;
+  if (list.empty()) {
+    failed_allocations_++;
+    return buffer(nullptr, releaser(this));
+  }
+
+  char *buf = list.back();
+  list.pop_back();
+  peak_used_ = std::max(peak_used_, n_blocks_ - free_list_.size() - cold_list_.size());
+  return buffer(buf, releaser(this));
+}
+
+size_t
+data_cache::block_pool::trim()
+{
+  std::unique_lock lock(mtx_);
+  if (free_list_.empty()) {
+    return 0;
+  }
+  size_t trimmed = 0;
+  if (hugepages_) {
+    // Explicit hugepages stay reserved for the pool whatever is done with them, only
+    // the accounting of the buffers changes
+    trimmed = free_list_.size() * block_size_;
+    cold_list_.insert(cold_list_.end(), free_list_.begin(), free_list_.end());
+    free_list_.clear();
+    return trimmed;
+  }
+
+  // Runs of adjacent free buffers are given back with a call each, down to the pages
+  // they cover entirely
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  std::sort(free_list_.begin(), free_list_.end());
+  std::vector<char *> resident;
+  size_t first = 0;
+  while (first < free_list_.size()) {
+    size_t last = first + 1;
+    while (last < free_list_.size() &&
+           free_list_[last] == free_list_[last - 1] + block_size_) {
+      last++;
+    }
+    const auto begin = reinterpret_cast<uintptr_t>(free_list_[first]);
+    const auto end = reinterpret_cast<uintptr_t>(free_list_[last - 1]) + block_size_;
+    const uintptr_t pages_begin = (begin + page_size - 1) / page_size * page_size;
+    const uintptr_t pages_end = end / page_size * page_size;
+    const bool advised =
+        pages_begin < pages_end &&
+        madvise(reinterpret_cast<void *>(pages_begin), pages_end - pages_begin,
+                MADV_DONTNEED) == 0;
+    for (size_t i = first; i < last; i++) {
+      const auto buf = reinterpret_cast<uintptr_t>(free_list_[i]);
+      if (advised && buf >= pages_begin && buf + block_size_ <= pages_end) {
+        cold_list_.push_back(free_list_[i]);
+        trimmed += block_size_;
+      } else {
+        resident.push_back(free_list_[i]);
+      }
+    }
+    first = last;
+  }
+  free_list_ = std::move(resident);
+  return trimmed;
+}
+
+size_t
+data_cache::block_pool::resident_bytes()
+{
+  std::unique_lock lock(mtx_);
+  return (n_blocks_ - cold_list_.size()) * block_size_;
+}
+
+void
+data_cache::block_pool::release(char *buf)
+{
+  std::unique_lock lock(mtx_);
+  free_list_.push_back(buf);
+}
+
+data_cache::block_pool::stats
+data_cache::block_pool::get_stats()
+{
+  std::unique_lock lock(mtx_);
+  return {
+      .capacity_ = n_blocks_,
+      .used_ = n_blocks_ - free_list_.size() - cold_list_.size(),
+      .peak_used_ = peak_used_,
+      .free_list_length_ = free_list_.size() + cold_list_.size(),
+      .cold_ = cold_list_.size(),
+      .failed_allocations_ = failed_allocations_,
+      .hugepages_ = hugepages_ ? n_blocks_ : 0,
+  };
+}
+
+data_cache::block_pool::releaser::releaser(block_pool *pool)
+    : pool_(pool)
+{
+}
+
+void
+data_cache::block_pool::releaser::operator()(char *buf) const
+{
+  if (buf != nullptr) {
+    pool_->release(buf);
+  }
+}
+
+data_cache::block_pool::stats &
+data_cache::block_pool::stats::operator+=(const stats &other)
+{
+  capacity_ += other.capacity_;
+  used_ += other.used_;
+  peak_used_ += other.peak_used_;
+  free_list_length_ += other.free_list_length_;
+  cold_ += other.cold_;
+  failed_allocations_ += other.failed_allocations_;
+  hugepages_ += other.hugepages_;
+  return *this;
+}
+
+double
+data_cache::block_pool::stats::utilization() const
+{
+  return capacity_ == 0 ? 0.0 : static_cast<double>(used_) / capacity_;
+}
+
+} // namespace rsafefs
@@ -1,15 +1,73 @@
 #include "rsafefs/layers/data_cache/cache.hpp"
 #include <algorithm>
 #include <cstring>
+#include <fcntl.h>
+#include <tuple>
 
 namespace rsafefs
 {
 
+// Closed files without blocks are swept once the index doubles past this size
+static constexpr size_t min_sweep_threshold = 1024;
+
 data_cache::cache::cache(config &config, const fuse_operations &operations)
     : config_(config)
     , operations_(operations)
-    , cache_size_(0)
+    , rules_(config.rules_)
+    , next_file_id_(0)
+    , sweep_threshold_(min_sweep_threshold)
+    , stop_refresh_(false)
+    , high_watermark_(0)
+    , low_watermark_(0)
+    , stop_reclaim_(false)
+    , n_fetches_(0)
+    , n_coalesced_(0)
+    , n_refreshes_(0)
+    , n_stale_serves_(0)
+    , n_reclaimed_(0)
+{
+  const size_t shard_capacity = config_.size_ / config_.shards_;
+  high_watermark_ = shard_capacity * config_.high_watermark_;
+  low_watermark_ = shard_capacity * config_.low_watermark_;
+  shards_.reserve(config_.shards_);
+  for (size_t i = 0; i < config_.shards_; i++) {
+    shards_.push_back(std::make_unique<shard>(config_, shard_capacity));
+  }
+
+  if (!config_.disk_directory_.empty()) {
+    disk_ = std::make_unique<disk_tier>(config_.disk_directory_, config_.disk_size_,
+                                        config_.block_size_);
+  }
+
+  if (config_.stale_while_revalidate_) {
+    for (size_t i = 0; i < config_.refresh_workers_; i++) {
+      refresh_workers_.emplace_back(&cache::refresh_worker, this);
+    }
+  }
+
+  if (config_.high_watermark_ < 1.0) {
+    reclaimer_ = std::thread(&cache::reclaimer, this);
+  }
+}
+
+data_cache::cache::~cache()
 {
+  if (reclaimer_.joinable()) {
+    std::unique_lock reclaim_lock(reclaim_mtx_);
+    stop_reclaim_ = true;
+    reclaim_lock.unlock();
+    reclaim_cv_.notify_all();
+    reclaimer_.join();
+  }
+
+  std::unique_lock lock(refresh_mtx_);
+  stop_refresh_ = true;
+  lock.unlock();
+  refresh_cv_.notify_all();
+
+  for (auto &worker : refresh_workers_) {
+    worker.join();
+  }
 }
 
 int
@@ -20,6 +78,22 @@ data_cache::cache::open(const char *path, struct fuse_file_info *fi)
     return res;
   }
 
+  // Without an entry the reads and writes of the file go straight to the next layer
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule != nullptr && rule->bypass_) {
+    return 0;
+  }
+
+  std::unique_lock files_lock(files_mtx_);
+  auto files_iterator = files_.find(path);
+  if (files_iterator != files_.end() &&
+      files_iterator->second.is_validated(config_.attr_time_out_)) {
+    // Checked by a recent open, skip the round trip to the next layer
+    files_iterator->second.handles_++;
+    return 0;
+  }
+  files_lock.unlock();
+
   struct stat stbuf {
   };
   const int attr_res = operations_.getattr(path, &stbuf);
@@ -27,24 +101,44 @@ data_cache::cache::open(const char *path, struct fuse_file_info *fi)
     return attr_res;
   }
 
-  std::unique_lock mtimes_lock(mtimes_mtx_);
-#ifdef __APPLE__
-  mtimes_[path] = stbuf.st_mtimespec;
-#else
-  mtimes_[path] = stbuf.st_mtim;
-#endif
+  files_lock.lock();
+  bool inserted = false;
+  const int time_out =
+      rule != nullptr ? rule->time_out_.value_or(config_.time_out_) : config_.time_out_;
+  const bool pinned = rule != nullptr && rule->pin_;
+  std::tie(files_iterator, inserted) =
+      files_.try_emplace(path, next_file_id_, stbuf, time_out, pinned);
+  bool changed = false;
+  if (inserted) {
+    next_file_id_++;
+    if (files_.size() > sweep_threshold_) {
+      sweep_files();
+    }
+  } else {
+    changed = files_iterator->second.revalidate(stbuf);
+  }
+  file &file = files_iterator->second;
+  file.handles_++;
+  files_lock.unlock();
 
+  if (changed) {
+    // The blocks of the previous version can't be read anymore
+    remove_blocks(file);
+  }
   return 0;
 }
 
 int
 data_cache::cache::release(const char *path, struct fuse_file_info *fi)
 {
-  {
-    std::unique_lock mtimes_lock(mtimes_mtx_);
-    mtimes_.erase(path);
+  file *file = find_file(path);
+  if (file != nullptr) {
+    // Pending refreshes may read through this handle
+    for (size_t n = file->refreshes_; n != 0; n = file->refreshes_) {
+      file->refreshes_.wait(n);
+    }
   }
-
+  release_file(path);
   return operations_.release(path, fi);
 }
 
@@ -54,134 +148,1323 @@ data_cache::cache::read(const char *path, char *buf, size_t size, off_t offset,
 {
   size_t readed = 0;
   off_t seeker = offset;
-  struct timespec file_mtime {
-  };
+  uint64_t file_version = 0;
+  file_identity file_identity{};
 
-  std::unique_lock mtimes_lock(mtimes_mtx_);
-  const auto mtimes_iterator = mtimes_.find(path);
-  if (mtimes_iterator != mtimes_.end()) {
-    file_mtime = mtimes_iterator->second;
-  } else {
+  std::shared_lock files_lock(files_mtx_);
+  const auto files_iterator = files_.find(path);
+  if (files_iterator == files_.end()) {
     // Do not use the cache, call read operation of the next layer
-    mtimes_lock.unlock();
+    files_lock.unlock();
     return operations_.read(path, buf, size, offset, fi);
   }
-  mtimes_lock.unlock();
+  // The entry outlives the read: it is only retired when its last handle is released
+  file &file = files_iterator->second;
+  file_version = file.version_;
+  file_identity = file.identity_;
+  files_lock.unlock();
+
+  // Blocks fetched by this read were touched when cached, copying them out isn't another
+  // reference for the eviction policy
+  size_t fetched_end = 0;
 
   while (readed != size) {
     size_t block_id = seeker / config_.block_size_;
-    key key = std::make_pair(path, block_id);
+    key key = std::make_pair(file.id_, block_id);
+    shard &shard = shard_of(key);
 
-    std::shared_lock cache_shared_lock(cache_mtx_);
-    const auto cache_iterator = cache_.find(key);
-    if (cache_iterator != cache_.end()) {
+    std::shared_lock shard_shared_lock(shard.mtx_);
+    const auto cache_iterator = shard.blocks_.find(key);
+    if (cache_iterator != shard.blocks_.end()) {
 
       block &block = cache_iterator->second;
       std::shared_lock block_shared_lock(block.mtx_);
-      if (!block.is_valid(config_.time_out_, file_mtime)) {
+      if (config_.stale_while_revalidate_ && block.version_ == file_version &&
+          block.is_expired(file.time_out_)) {
+        // Serve the expired block as is, a worker reads it again in the background
+        n_stale_serves_++;
+        if (!block.refreshing_.exchange(true)) {
+          schedule_refresh(file, key, path, fi, file_version);
+        }
+      } else if (!block.is_valid(file.time_out_, file_version)) {
         block_shared_lock.unlock();
 
-        // Update block
+        // Update block, unless a concurrent reader already did it
         std::unique_lock lock_block(block.mtx_);
-        const int res = operations_.read(path, block.buf_.get(), config_.block_size_,
-                                         block.offset_, fi);
-        block.size_ = res;
-        block.timestamp_ = std::chrono::high_resolution_clock::now();
-        block.mtime_ = file_mtime;
+        int res = 0;
+        if (block.is_valid(file.time_out_, file_version)) {
+          n_coalesced_++;
+        } else {
+          n_fetches_++;
+          res = operations_.read(path, block.buf_.get(), config_.block_size_,
+                                 block.offset_, fi);
+          block.size_ = res;
+          block.timestamp_ = std::chrono::high_resolution_clock::now();
+          block.version_ = file_version;
+        }
         lock_block.unlock();
 
         if (res < 0) {
           // Remove block
-          cache_shared_lock.unlock();
-          remove_block(key);
-          config_.eviction_policy_->remove(key);
+          shard_shared_lock.unlock();
+          remove_block(shard, key);
           return res;
         }
 
         block_shared_lock.lock();
       }
 
-      off_t offset_in_the_block = seeker - block.offset_;
-      size_t n_bytes_to_copy =
-          std::min(size - readed, block.size_ - static_cast<size_t>(offset_in_the_block));
-      if (n_bytes_to_copy == 0) {
+      const size_t offset_in_the_block = seeker - block.offset_;
+      if (offset_in_the_block >= block.size_) {
+        // End of file
         break;
       }
+      const size_t n_bytes_to_copy =
+          std::min(size - readed, block.size_ - offset_in_the_block);
 
       std::memcpy(buf + readed, block.buf_.get() + offset_in_the_block, n_bytes_to_copy);
       block_shared_lock.unlock();
-      cache_shared_lock.unlock();
+      if (block_id >= fetched_end) {
+        record_hit(shard, block);
+      }
+      shard_shared_lock.unlock();
 
       readed += n_bytes_to_copy;
       seeker += n_bytes_to_copy;
     } else {
-      cache_shared_lock.unlock();
-      if (cache_size_ > config_.size_) {
-        auto selected_key = config_.eviction_policy_->evict();
-        if (selected_key) {
-          remove_block(selected_key.value());
+      shard_shared_lock.unlock();
+
+      std::unique_lock shard_lock(shard.mtx_);
+      if (shard.blocks_.contains(key)) {
+        // Cached by a concurrent reader in the meantime
+        continue;
+      }
+
+      std::shared_ptr<fetch> &fetch_entry = shard.fetches_[key];
+      if (fetch_entry != nullptr) {
+        // Another reader is already fetching this block, wait for it instead
+        const std::shared_ptr<fetch> pending = fetch_entry;
+        shard_lock.unlock();
+        n_coalesced_++;
+        const int res = pending->wait();
+        if (res < 0) {
+          return res;
         }
+        if (res == 0) {
+          break;
+        }
+        continue;
+      }
+      std::shared_ptr<fetch> pending = fetch_entry = std::make_shared<fetch>();
+      shard_lock.unlock();
+
+      const size_t end_block_id =
+          (offset + size + config_.block_size_ - 1) / config_.block_size_;
+      const auto res = fetch_blocks(file, key, std::move(pending), end_block_id, path,
+                                    file_version, file_identity, fi);
+      if (!res) {
+        // Every block of the shard is taken by concurrent misses, skip the cache
+        const int res = operations_.read(path, buf + readed, size - readed, seeker, fi);
+        return res < 0 ? res : readed + res;
       }
+      if (res.value() < 0) {
+        return res.value();
+      }
+      if (res.value() == 0) {
+        break;
+      }
+      fetched_end = std::min(end_block_id, block_id + config_.max_fetch_blocks_);
+    }
+  }
+  return readed;
+}
+
+int
+data_cache::cache::write(const char *path, const char *buf, size_t size, off_t offset,
+                         struct fuse_file_info *fi)
+{
+  file *file = find_file(path);
+  if (file == nullptr) {
+    return operations_.write(path, buf, size, offset, fi);
+  }
+
+  const uint64_t started = begin_modification(*file);
+  const int res = operations_.write(path, buf, size, offset, fi);
+  std::unique_lock write_lock(file->write_mtx_);
+  const bool alone = end_modification(*file, started);
+  if (res <= 0) {
+    return res;
+  }
+
+  const off_t file_size = size_of(*file);
+  if (alone) {
+    // Write through: the cached blocks get the same bytes as the next layer
+    if (offset > file_size) {
+      resize_blocks(*file, file_size, offset);
+    }
+    write_blocks(*file, buf, res, offset);
+  } else {
+    // Includes the old last block, which a gap before the write would have grown
+    const size_t block_size = config_.block_size_;
+    drop_blocks(*file, std::min(offset, file_size) / block_size,
+                (offset + res + block_size - 1) / block_size);
+  }
+  modified(*file, std::max(file_size, static_cast<off_t>(offset + res)));
+  write_lock.unlock();
+  record_identity(*file, path);
+  return res;
+}
+
+int
+data_cache::cache::truncate(const char *path, off_t size)
+{
+  // No handle has to be open, pin the file while it is truncated
+  file *file = acquire_file(path);
+  if (file == nullptr) {
+    return operations_.truncate(path, size);
+  }
+
+  const uint64_t started = begin_modification(*file);
+  const int res = operations_.truncate(path, size);
+  std::unique_lock write_lock(file->write_mtx_);
+  const bool alone = end_modification(*file, started);
+  if (res == 0 && alone) {
+    resize_blocks(*file, size_of(*file), size);
+    modified(*file, size);
+  }
+  write_lock.unlock();
+  if (res == 0 && !alone) {
+    invalidate(*file, path);
+  } else if (res == 0) {
+    record_identity(*file, path);
+  }
+
+  release_file(path);
+  return res;
+}
+
+int
+data_cache::cache::ftruncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+  file *file = find_file(path);
+  if (file == nullptr) {
+    return operations_.ftruncate(path, size, fi);
+  }
+
+  const uint64_t started = begin_modification(*file);
+  const int res = operations_.ftruncate(path, size, fi);
+  std::unique_lock write_lock(file->write_mtx_);
+  const bool alone = end_modification(*file, started);
+  if (res == 0 && alone) {
+    resize_blocks(*file, size_of(*file), size);
+    modified(*file, size);
+  }
+  write_lock.unlock();
+  if (res == 0 && !alone) {
+    invalidate(*file, path);
+  } else if (res == 0) {
+    record_identity(*file, path);
+  }
+  return res;
+}
+
+int
+data_cache::cache::fallocate(const char *path, int mode, off_t offset, off_t length,
+                             struct fuse_file_info *fi)
+{
+  file *file = find_file(path);
+  if (file == nullptr) {
+    return operations_.fallocate(path, mode, offset, length, fi);
+  }
+
+  const uint64_t started = begin_modification(*file);
+  const int res = operations_.fallocate(path, mode, offset, length, fi);
+  std::unique_lock write_lock(file->write_mtx_);
+  const bool alone = end_modification(*file, started);
+  if (res != 0) {
+    return res;
+  }
+  if (!alone) {
+    write_lock.unlock();
+    invalidate(*file, path);
+    return res;
+  }
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+  const off_t file_size = size_of(*file);
+  const off_t end = offset + length;
+  const bool keep_size = (mode & FALLOC_FL_KEEP_SIZE) != 0;
+  const off_t new_size = keep_size ? file_size : std::max(file_size, end);
+  mode &= ~FALLOC_FL_KEEP_SIZE;
+  if (mode == FALLOC_FL_PUNCH_HOLE || mode == FALLOC_FL_ZERO_RANGE) {
+    // The range reads back as zeros
+    resize_blocks(*file, file_size, new_size);
+    if (offset < new_size) {
+      write_blocks(*file, nullptr, std::min(end, new_size) - offset, offset);
+    }
+    modified(*file, new_size);
+    write_lock.unlock();
+    record_identity(*file, path);
+    return res;
+  }
+  if (mode == 0) {
+    // Plain allocation only changes the size of the file
+    resize_blocks(*file, file_size, new_size);
+    modified(*file, new_size);
+    write_lock.unlock();
+    record_identity(*file, path);
+    return res;
+  }
+#endif
+  // Ranges are shifted, none of the cached blocks can be trusted
+  write_lock.unlock();
+  invalidate(*file, path);
+  return res;
+}
+
+size_t
+data_cache::cache::size() const
+{
+  size_t size = 0;
+  for (const auto &shard : shards_) {
+    size += shard->size_;
+  }
+  return size;
+}
+
+data_cache::cache::fetch_counters
+data_cache::cache::fetch_stats() const
+{
+  return {.fetches_ = n_fetches_,
+          .coalesced_ = n_coalesced_,
+          .refreshes_ = n_refreshes_,
+          .stale_serves_ = n_stale_serves_};
+}
+
+read_buffer_stats
+data_cache::cache::hit_buffer_stats() const
+{
+  read_buffer_stats stats{};
+  for (const auto &shard : shards_) {
+    stats += shard->hits_.get_stats();
+  }
+  return stats;
+}
+
+size_t
+data_cache::cache::memory_usage() const
+{
+  size_t usage = 0;
+  for (const auto &shard : shards_) {
+    usage += shard->pool_.resident_bytes();
+  }
+  return usage;
+}
+
+size_t
+data_cache::cache::memory_hits() const
+{
+  const read_buffer_stats stats = hit_buffer_stats();
+  return stats.recorded_ + stats.dropped_;
+}
 
-      const off_t block_offset = block_id * config_.block_size_;
-      auto new_buf = std::make_unique<char[]>(config_.block_size_);
-      const int block_size =
-          operations_.read(path, new_buf.get(), config_.block_size_, block_offset, fi);
-      if (block_size < 0)
-        return block_size;
-      if (block_size == 0)
+size_t
+data_cache::cache::shrink(size_t bytes)
+{
+  const size_t old_usage = memory_usage();
+  // Free buffers still resident are given back before any block is evicted
+  size_t released = 0;
+  for (auto &shard : shards_) {
+    const block_pool::stats stats = shard->pool_.get_stats();
+    released += (stats.free_list_length_ - stats.cold_) * config_.block_size_;
+  }
+  bool evicted = true;
+  while (released < bytes && evicted) {
+    evicted = false;
+    for (auto &shard : shards_) {
+      const size_t old_size = shard->size_;
+      if (old_size == 0) {
+        continue;
+      }
+      evict_block(*shard);
+      const size_t new_size = shard->size_;
+      if (new_size < old_size) {
+        released += old_size - new_size;
+        evicted = true;
+      }
+      if (released >= bytes) {
         break;
+      }
+    }
+  }
+
+  // Evicted buffers only go back to the pools, their pages are given back here so the
+  // memory of the process shrinks too
+  for (auto &shard : shards_) {
+    shard->pool_.trim();
+  }
+  const size_t new_usage = memory_usage();
+  return old_usage > new_usage ? old_usage - new_usage : 0;
+}
+
+std::vector<utils::manifest_entry>
+data_cache::cache::manifest()
+{
+  struct cached_block {
+    file_id file_id_;
+    uint64_t block_id_;
+    uint64_t version_;
+    std::chrono::high_resolution_clock::time_point timestamp_;
+  };
+  std::vector<cached_block> cached_blocks;
+  for (auto &shard : shards_) {
+    std::shared_lock lock(shard->mtx_);
+    for (auto &[key, block] : shard->blocks_) {
+      std::shared_lock block_lock(block.mtx_);
+      cached_blocks.push_back({key.first, key.second, block.version_, block.timestamp_});
+    }
+  }
+  std::sort(cached_blocks.begin(), cached_blocks.end(),
+            [](const cached_block &a, const cached_block &b) {
+              return a.timestamp_ > b.timestamp_;
+            });
+
+  std::vector<utils::manifest_entry> entries;
+  absl::flat_hash_map<file_id, size_t> entry_of_file;
+  std::shared_lock files_lock(files_mtx_);
+  absl::flat_hash_map<file_id, std::pair<const std::string *, const file *>> files;
+  for (const auto &[path, file] : files_) {
+    files.emplace(file.id_, std::make_pair(&path, &file));
+  }
+  for (const auto &cached_block : cached_blocks) {
+    // Blocks of an older version of the file are invalid already
+    const auto files_iterator = files.find(cached_block.file_id_);
+    if (files_iterator == files.end() ||
+        files_iterator->second.second->version_ != cached_block.version_) {
+      continue;
+    }
+    const auto [entry_iterator, inserted] =
+        entry_of_file.try_emplace(cached_block.file_id_, entries.size());
+    if (inserted) {
+      const auto &[path, file] = files_iterator->second;
+      entries.push_back({.path_ = *path,
+                         .mtime_ = file->identity_.mtime_,
+                         .size_ = file->identity_.size_,
+                         .blocks_ = {}});
+    }
+    entries[entry_iterator->second].blocks_.push_back(cached_block.block_id_);
+  }
+  return entries;
+}
+
+size_t
+data_cache::cache::reclaimed_blocks() const
+{
+  return n_reclaimed_;
+}
 
-      std::unique_lock lock(cache_mtx_);
-      auto pair = cache_.try_emplace(key, std::move(new_buf), block_size, block_offset,
-                                     file_mtime);
+std::optional<data_cache::disk_tier::stats>
+data_cache::cache::disk_stats() const
+{
+  if (disk_ == nullptr) {
+    return {};
+  }
+  return disk_->get_stats();
+}
+
+data_cache::block_pool::stats
+data_cache::cache::allocator_stats() const
+{
+  block_pool::stats stats{};
+  for (const auto &shard : shards_) {
+    stats += shard->pool_.get_stats();
+  }
+  return stats;
+}
+
+data_cache::cache::shard &
+data_cache::cache::shard_of(const key &key)
+{
+  return *shards_[absl::Hash<data_cache::key>{}(key) % shards_.size()];
+}
+
+data_cache::key
+data_cache::cache::key_of(const block &block) const
+{
+  return std::make_pair(block.file_.id_, block.offset_ / config_.block_size_);
+}
+
+void
+data_cache::cache::touch_block(shard &shard, const key &key, block &block)
+{
+  if (block.file_.pinned_) {
+    // Out of the reach of the eviction policy
+    return;
+  }
+  std::visit([&](auto &policy) { policy.touch(key, block); }, shard.policy_);
+}
+
+void
+data_cache::cache::record_hit(shard &shard, block &block)
+{
+  if (shard.hits_.record(&block)) {
+    shard.hits_.try_drain([&](auto *hit) {
+      touch_block(shard, key_of(*hit), *hit);
+    });
+  }
+}
+
+void
+data_cache::cache::drain_hits(shard &shard)
+{
+  shard.hits_.drain([&](auto *hit) {
+    touch_block(shard, key_of(*hit), *hit);
+  });
+}
+
+void
+data_cache::cache::remove_block(shard &shard, const key &key, bool stale)
+{
+  std::unique_lock lock(shard.mtx_);
+  if (stale) {
+    const auto fetch_iterator = shard.fetches_.find(key);
+    if (fetch_iterator != shard.fetches_.end()) {
+      fetch_iterator->second->stale_ = true;
+    }
+  }
+  drain_hits(shard);
+  const auto cache_iterator = shard.blocks_.find(key);
+  if (cache_iterator != shard.blocks_.end()) {
+    // Pinned blocks were never handed to the eviction policy
+    if (!cache_iterator->second.file_.pinned_) {
+      std::visit([&](auto &policy) { policy.remove(key, cache_iterator->second); },
+                 shard.policy_);
+    }
+    shard.size_ -= config_.block_size_;
+    cache_iterator->second.file_.n_blocks_--;
+    shard.blocks_.erase(cache_iterator);
+  }
+}
+
+data_cache::cache::file *
+data_cache::cache::find_file(const char *path)
+{
+  std::shared_lock files_lock(files_mtx_);
+  const auto files_iterator = files_.find(path);
+  return files_iterator != files_.end() ? &files_iterator->second : nullptr;
+}
+
+data_cache::cache::file *
+data_cache::cache::acquire_file(const char *path)
+{
+  std::unique_lock files_lock(files_mtx_);
+  const auto files_iterator = files_.find(path);
+  if (files_iterator == files_.end()) {
+    return nullptr;
+  }
+  files_iterator->second.handles_++;
+  return &files_iterator->second;
+}
+
+void
+data_cache::cache::release_file(const char *path)
+{
+  std::unique_lock files_lock(files_mtx_);
+  const auto files_iterator = files_.find(path);
+  if (files_iterator != files_.end() && --files_iterator->second.handles_ == 0 &&
+      files_iterator->second.n_blocks_ == 0) {
+    // Nothing left to keep the file id for, the next open interns a new one
+    files_.erase(files_iterator);
+  }
+}
+
+void
+data_cache::cache::sweep_files()
+{
+  // Retire the closed files whose blocks were all evicted since their last release
+  for (auto files_iterator = files_.begin(); files_iterator != files_.end();) {
+    const file &file = files_iterator->second;
+    if (file.handles_ == 0 && file.n_blocks_ == 0) {
+      files_.erase(files_iterator++);
+    } else {
+      ++files_iterator;
+    }
+  }
+  sweep_threshold_ = std::max(min_sweep_threshold, 2 * files_.size());
+}
+
+void
+data_cache::cache::write_blocks(file &file, const char *buf, size_t size, off_t offset)
+{
+  const size_t block_size = config_.block_size_;
+  const size_t end = offset + size;
+  for (size_t block_id = offset / block_size; block_id * block_size < end; block_id++) {
+    const key key = std::make_pair(file.id_, block_id);
+    shard &shard = shard_of(key);
+
+    std::shared_lock shard_lock(shard.mtx_);
+    const auto fetch_iterator = shard.fetches_.find(key);
+    if (fetch_iterator != shard.fetches_.end()) {
+      fetch_iterator->second->stale_ = true;
+    }
+    const auto cache_iterator = shard.blocks_.find(key);
+    if (cache_iterator == shard.blocks_.end()) {
+      continue;
+    }
+
+    block &block = cache_iterator->second;
+    const size_t block_offset = block_id * block_size;
+    const size_t first = std::max<size_t>(offset, block_offset) - block_offset;
+    const size_t last = std::min(end, block_offset + block_size) - block_offset;
+
+    std::unique_lock block_lock(block.mtx_);
+    if (first > block.size_) {
+      // The write starts past the end of the block, the gap reads back as zeros
+      std::memset(block.buf_.get() + block.size_, 0, first - block.size_);
+    }
+    if (buf != nullptr) {
+      std::memcpy(block.buf_.get() + first, buf + (block_offset + first - offset),
+                  last - first);
+    } else {
+      std::memset(block.buf_.get() + first, 0, last - first);
+    }
+    block.size_ = std::max(block.size_, last);
+  }
+
+  if (disk_ != nullptr) {
+    disk_->remove(identity_of(file).ino_, offset / block_size,
+                  (end + block_size - 1) / block_size);
+  }
+}
+
+void
+data_cache::cache::resize_blocks(file &file, size_t old_size, size_t new_size)
+{
+  const size_t block_size = config_.block_size_;
+
+  if (new_size > old_size) {
+    // The old last block grows with zeros up to the new end of file
+    const size_t block_id = old_size / block_size;
+    resize_block(std::make_pair(file.id_, block_id),
+                 std::min(block_size, new_size - block_id * block_size));
+    if (disk_ != nullptr) {
+      disk_->remove(identity_of(file).ino_, block_id, block_id + 1);
+    }
+    return;
+  }
+  if (new_size == old_size) {
+    return;
+  }
+
+  // Blocks past the new end of file are dropped, the new last one is shortened
+  const size_t first_removed = (new_size + block_size - 1) / block_size;
+  if (new_size % block_size != 0) {
+    resize_block(std::make_pair(file.id_, new_size / block_size), new_size % block_size);
+  }
+  for (const size_t block_id : block_ids_of(file, first_removed)) {
+    const key key = std::make_pair(file.id_, block_id);
+    remove_block(shard_of(key), key, true);
+  }
+
+  if (disk_ != nullptr) {
+    disk_->remove(identity_of(file).ino_, new_size / block_size);
+  }
+}
+
+void
+data_cache::cache::resize_block(const key &key, size_t block_size)
+{
+  shard &shard = shard_of(key);
+  std::shared_lock shard_lock(shard.mtx_);
+  const auto fetch_iterator = shard.fetches_.find(key);
+  if (fetch_iterator != shard.fetches_.end()) {
+    fetch_iterator->second->stale_ = true;
+  }
+  const auto cache_iterator = shard.blocks_.find(key);
+  if (cache_iterator == shard.blocks_.end()) {
+    return;
+  }
+
+  block &block = cache_iterator->second;
+  std::unique_lock block_lock(block.mtx_);
+  if (block_size > block.size_) {
+    std::memset(block.buf_.get() + block.size_, 0, block_size - block.size_);
+  }
+  block.size_ = block_size;
+}
+
+data_cache::file_identity
+data_cache::cache::identity_of(file &file)
+{
+  std::shared_lock files_lock(files_mtx_);
+  return file.identity_;
+}
+
+off_t
+data_cache::cache::size_of(file &file)
+{
+  std::shared_lock files_lock(files_mtx_);
+  return file.size_;
+}
+
+void
+data_cache::cache::modified(file &file, off_t size, bool invalidate)
+{
+  std::unique_lock files_lock(files_mtx_);
+  file.size_ = size;
+  file.locally_modified_ = true;
+  if (invalidate) {
+    file.version_++;
+  }
+}
+
+uint64_t
+data_cache::cache::begin_modification(file &file)
+{
+  std::unique_lock write_lock(file.write_mtx_);
+  file.modifying_++;
+  return file.modifications_;
+}
+
+bool
+data_cache::cache::end_modification(file &file, uint64_t started)
+{
+  // Any other modification that began before this one ended is still counted here or
+  // completed since it started
+  const bool alone = file.modifying_ == 1 && file.modifications_ == started;
+  file.modifying_--;
+  file.modifications_++;
+  return alone;
+}
+
+void
+data_cache::cache::drop_blocks(file &file, size_t first_block_id, size_t end_block_id)
+{
+  for (size_t block_id = first_block_id; block_id < end_block_id; block_id++) {
+    const key key = std::make_pair(file.id_, block_id);
+    remove_block(shard_of(key), key, true);
+  }
+  if (disk_ != nullptr) {
+    disk_->remove(identity_of(file).ino_, first_block_id, end_block_id);
+  }
+}
+
+void
+data_cache::cache::invalidate(file &file, const char *path)
+{
+  struct stat stbuf {
+  };
+  const int attr_res = operations_.getattr(path, &stbuf);
+  std::unique_lock files_lock(files_mtx_);
+  if (attr_res == 0) {
+    file.size_ = stbuf.st_size;
+    file.modified_identity_.emplace(stbuf);
+  } else {
+    file.modified_identity_.reset();
+  }
+  file.locally_modified_ = true;
+  file.version_++;
+  const ino_t ino = file.identity_.ino_;
+  files_lock.unlock();
+  if (disk_ != nullptr) {
+    disk_->remove(ino, 0);
+  }
+}
+
+void
+data_cache::cache::record_identity(file &file, const char *path)
+{
+  struct stat stbuf {
+  };
+  const int attr_res = operations_.getattr(path, &stbuf);
+  std::unique_lock files_lock(files_mtx_);
+  if (attr_res == 0) {
+    file.modified_identity_.emplace(stbuf);
+  } else {
+    file.modified_identity_.reset();
+  }
+}
+
+std::optional<int>
+data_cache::cache::fetch_blocks(file &file, const key &first_key,
+                                std::shared_ptr<fetch> first_fetch, size_t end_block_id,
+                                const char *path, uint64_t version,
+                                const file_identity &identity,
+                                struct fuse_file_info *fi)
+{
+  struct claim {
+    key key_;
+    shard *shard_;
+    std::shared_ptr<fetch> fetch_;
+    block_pool::buffer buf_;
+  };
+
+  std::vector<claim> claims;
+  claims.push_back({first_key, &shard_of(first_key), std::move(first_fetch), {}});
+
+  // A block demoted to the disk tier is promoted on its own
+  const bool on_disk = disk_ != nullptr && disk_->contains(identity, first_key.second);
+
+  // Claim the following blocks of the request while nobody has them or is fetching them
+  const size_t last_block_id =
+      on_disk ? first_key.second + 1
+              : std::min(end_block_id, first_key.second + config_.max_fetch_blocks_);
+  for (size_t block_id = first_key.second + 1; block_id < last_block_id; block_id++) {
+    const key key = std::make_pair(file.id_, block_id);
+    shard &shard = shard_of(key);
+    if (disk_ != nullptr && disk_->contains(identity, block_id)) {
+      break;
+    }
+
+    std::unique_lock lock(shard.mtx_);
+    if (shard.blocks_.contains(key) || shard.fetches_.contains(key)) {
+      break;
+    }
+    auto pending = std::make_shared<fetch>();
+    shard.fetches_.emplace(key, pending);
+    lock.unlock();
+
+    claims.push_back({key, &shard, std::move(pending), {}});
+  }
+
+  // Reserve a buffer for every claimed block, the run ends at the first one without it
+  size_t n_blocks = 0;
+  for (; n_blocks < claims.size(); n_blocks++) {
+    shard &shard = *claims[n_blocks].shard_;
+    if (shard.size_ > shard.capacity_) {
+      evict_block(shard);
+    }
+    claims[n_blocks].buf_ = shard.pool_.allocate();
+    if (!claims[n_blocks].buf_) {
+      evict_block(shard);
+      claims[n_blocks].buf_ = shard.pool_.allocate();
+    }
+    if (!claims[n_blocks].buf_) {
+      break;
+    }
+  }
+  for (size_t i = n_blocks; i < claims.size(); i++) {
+    complete_fetch(*claims[i].shard_, claims[i].key_, *claims[i].fetch_, fetch::retry);
+  }
+  if (n_blocks == 0) {
+    return {};
+  }
+  claims.erase(claims.begin() + n_blocks, claims.end());
+
+  const size_t block_size = config_.block_size_;
+  const off_t run_offset = first_key.second * block_size;
+  std::optional<size_t> promoted;
+  if (on_disk) {
+    promoted = disk_->get(identity, first_key.second, claims[0].buf_.get());
+  }
+
+  int res = 0;
+  if (promoted) {
+    res = static_cast<int>(promoted.value());
+  } else if (n_blocks == 1) {
+    n_fetches_++;
+    res = operations_.read(path, claims[0].buf_.get(), block_size, run_offset, fi);
+  } else {
+    // A single call to the next layer for the whole run, split into blocks afterwards
+    n_fetches_++;
+    thread_local std::vector<char> run_buf;
+    if (run_buf.size() < n_blocks * block_size) {
+      run_buf.resize(n_blocks * block_size);
+    }
+    res = operations_.read(path, run_buf.data(), n_blocks * block_size, run_offset, fi);
+    const size_t run_bytes = std::max(res, 0);
+    for (size_t i = 0; i * block_size < run_bytes; i++) {
+      std::memcpy(claims[i].buf_.get(), run_buf.data() + i * block_size,
+                  std::min(block_size, run_bytes - i * block_size));
+    }
+  }
+
+  int first_block_res = res;
+  for (size_t i = 0; i < claims.size(); i++) {
+    claim &claim = claims[i];
+    shard &shard = *claim.shard_;
+
+    // Bytes of the run that landed in this block, a short read means end of file
+    int block_res = res;
+    if (res >= 0) {
+      const size_t run_bytes = res;
+      block_res = i * block_size < run_bytes
+                      ? static_cast<int>(std::min(block_size, run_bytes - i * block_size))
+                      : 0;
+    }
+    if (i == 0) {
+      first_block_res = block_res;
+    }
+
+    if (block_res <= 0) {
+      complete_fetch(shard, claim.key_, *claim.fetch_, block_res);
+      continue;
+    }
+
+    std::unique_lock lock(shard.mtx_);
+    if (claim.fetch_->stale_) {
+      // The file was modified during the read, look the block up again
+      shard.fetches_.erase(claim.key_);
       lock.unlock();
-      if (pair.second) {
-        cache_size_ += config_.block_size_;
+      claim.fetch_->complete(fetch::retry);
+      if (i == 0) {
+        first_block_res = fetch::retry;
       }
+      continue;
+    }
+    auto pair = shard.blocks_.try_emplace(claim.key_, file, std::move(claim.buf_),
+                                          block_res, claim.key_.second * block_size,
+                                          version);
+    if (pair.second) {
+      file.n_blocks_++;
+      touch_block(shard, claim.key_, pair.first->second);
+    }
+    shard.fetches_.erase(claim.key_);
+    lock.unlock();
+    claim.fetch_->complete(block_res);
+
+    if (pair.second) {
+      if ((shard.size_ += block_size) > high_watermark_ && reclaimer_.joinable()) {
+        reclaim_cv_.notify_one();
+      }
+      file.cached_block(claim.key_.second);
     }
-    config_.eviction_policy_->touch(key);
   }
-  return readed;
+
+  return first_block_res;
 }
 
 void
-data_cache::cache::remove_block(key &key)
+data_cache::cache::evict_block(shard &shard)
+{
+  evict_blocks(shard, 1);
+}
+
+size_t
+data_cache::cache::evict_blocks(shard &shard, size_t count)
 {
-  std::unique_lock lock(cache_mtx_);
-  const auto cache_iterator = cache_.find(key);
-  if (cache_iterator != cache_.end()) {
-    cache_size_ -= config_.block_size_;
-    cache_.erase(cache_iterator);
+  // The lock keeps the blocks in place while the hits are replayed and the keys are read
+  std::shared_lock lock(shard.mtx_);
+  drain_hits(shard);
+  std::vector<key> selected_keys;
+  selected_keys.reserve(count);
+  while (selected_keys.size() < count) {
+    const std::optional<key> selected_key =
+        std::visit([](auto &policy) { return policy.evict(); }, shard.policy_);
+    if (!selected_key) {
+      break;
+    }
+    selected_keys.push_back(selected_key.value());
   }
+  lock.unlock();
+
+  for (const key &selected_key : selected_keys) {
+    if (disk_ != nullptr) {
+      demote_block(shard, selected_key);
+    } else {
+      remove_block(shard, selected_key);
+    }
+  }
+  return selected_keys.size();
 }
 
-data_cache::cache::block::block(std::unique_ptr<char[]> buf, size_t size, off_t offset,
-                                struct timespec &mtime)
-    : buf_(std::move(buf))
+void
+data_cache::cache::reclaimer()
+{
+  // Misses wake it up past the high watermark, the period catches the ones it missed
+  static constexpr auto period = std::chrono::milliseconds(100);
+  const size_t block_size = config_.block_size_;
+
+  std::unique_lock lock(reclaim_mtx_);
+  while (!stop_reclaim_) {
+    reclaim_cv_.wait_for(lock, period);
+    lock.unlock();
+    for (auto &shard : shards_) {
+      const size_t size = shard->size_;
+      if (size <= high_watermark_) {
+        continue;
+      }
+      const size_t count = (size - low_watermark_ + block_size - 1) / block_size;
+      n_reclaimed_ += evict_blocks(*shard, count);
+    }
+    lock.lock();
+  }
+}
+
+void
+data_cache::cache::demote_block(shard &shard, const key &key)
+{
+  std::unique_lock shard_lock(shard.mtx_);
+  drain_hits(shard);
+  const auto cache_iterator = shard.blocks_.find(key);
+  if (cache_iterator == shard.blocks_.end()) {
+    return;
+  }
+
+  block &block = cache_iterator->second;
+  file &file = block.file_;
+  std::shared_lock files_lock(files_mtx_);
+  const file_identity identity = file.identity_;
+  const uint64_t version = block.version_;
+  const bool current = version == file.version_;
+  files_lock.unlock();
+  // Without an inode number blocks of different files can't be told apart on disk
+  const bool demoted = current && identity.ino_ != 0 && !block.is_expired(file.time_out_);
+
+  // The buffer is taken out of the block, which leaves the shard right away
+  block_pool::buffer buf = std::move(block.buf_);
+  const size_t size = block.size_;
+  if (!file.pinned_) {
+    std::visit([&](auto &policy) { policy.remove(key, block); }, shard.policy_);
+  }
+  shard.size_ -= config_.block_size_;
+  shard.blocks_.erase(cache_iterator);
+  if (!demoted) {
+    file.n_blocks_--;
+    return;
+  }
+
+  // Misses of the block wait for the write, and the modifications of the file mark it
+  // stale as they would mark a read from the next layer
+  const auto pending = std::make_shared<fetch>();
+  shard.fetches_[key] = pending;
+  shard_lock.unlock();
+
+  disk_->put(identity, key.second, buf.get(), size);
+  buf.reset();
+
+  shard_lock.lock();
+  shard.fetches_.erase(key);
+  files_lock.lock();
+  const bool stale = pending->stale_ || file.version_ != version;
+  // The file outlives the write: its entry is kept while it counts the block
+  file.n_blocks_--;
+  files_lock.unlock();
+  shard_lock.unlock();
+  if (stale) {
+    disk_->remove(identity.ino_, key.second, key.second + 1);
+  }
+  pending->complete(fetch::retry);
+}
+
+void
+data_cache::cache::complete_fetch(shard &shard, const key &key, fetch &fetch, int result)
+{
+  std::unique_lock lock(shard.mtx_);
+  shard.fetches_.erase(key);
+  lock.unlock();
+  fetch.complete(result);
+}
+
+void
+data_cache::cache::remove_blocks(const file &file)
+{
+  for (const size_t block_id : block_ids_of(file, 0)) {
+    const key key = std::make_pair(file.id_, block_id);
+    remove_block(shard_of(key), key);
+  }
+}
+
+std::vector<size_t>
+data_cache::cache::block_ids_of(const file &file, size_t first_block_id)
+{
+  std::vector<size_t> block_ids;
+  const size_t blocks_end = file.blocks_end_;
+  if (first_block_id >= blocks_end) {
+    return block_ids;
+  }
+
+  // A scan costs one step per cached block of any file, a probe one lock per id
+  if (blocks_end - first_block_id <= size() / config_.block_size_ + shards_.size()) {
+    block_ids.reserve(blocks_end - first_block_id);
+    for (size_t block_id = first_block_id; block_id < blocks_end; block_id++) {
+      block_ids.push_back(block_id);
+    }
+    return block_ids;
+  }
+  for (auto &shard : shards_) {
+    std::shared_lock lock(shard->mtx_);
+    for (const auto &[key, block] : shard->blocks_) {
+      if (key.first == file.id_ && key.second >= first_block_id) {
+        block_ids.push_back(key.second);
+      }
+    }
+    for (const auto &[key, fetch] : shard->fetches_) {
+      if (key.first == file.id_ && key.second >= first_block_id) {
+        block_ids.push_back(key.second);
+      }
+    }
+  }
+  return block_ids;
+}
+
+void
+data_cache::cache::schedule_refresh(file &file, const key &key, const char *path,
+                                    struct fuse_file_info *fi, uint64_t version)
+{
+  file.refreshes_++;
+  std::unique_lock lock(refresh_mtx_);
+  refresh_queue_.push_back({&file, key, path, *fi, version});
+  lock.unlock();
+  refresh_cv_.notify_one();
+}
+
+void
+data_cache::cache::refresh_worker()
+{
+  while (true) {
+    std::unique_lock lock(refresh_mtx_);
+    refresh_cv_.wait(lock, [this] {
+      return stop_refresh_ || !refresh_queue_.empty();
+    });
+    if (refresh_queue_.empty()) {
+      return;
+    }
+    const refresh refresh = std::move(refresh_queue_.front());
+    refresh_queue_.pop_front();
+    lock.unlock();
+
+    refresh_block(refresh);
+    if (--refresh.file_->refreshes_ == 0) {
+      refresh.file_->refreshes_.notify_all();
+    }
+  }
+}
+
+void
+data_cache::cache::refresh_block(const refresh &refresh)
+{
+  shard &shard = shard_of(refresh.key_);
+  off_t offset = 0;
+  block_pool::buffer buf;
+
+  // A modification that reaches the next layer during the read would be lost by the copy
+  // swapped in below, so none may be in progress nor completed in the meantime
+  std::unique_lock write_lock(refresh.file_->write_mtx_);
+  const bool modifying = refresh.file_->modifying_ != 0;
+  const uint64_t modifications = refresh.file_->modifications_;
+  write_lock.unlock();
+
+  std::shared_lock shard_lock(shard.mtx_);
+  auto cache_iterator = shard.blocks_.find(refresh.key_);
+  if (cache_iterator == shard.blocks_.end()) {
+    // Evicted or removed in the meantime
+    return;
+  }
+  {
+    block &block = cache_iterator->second;
+    std::shared_lock block_lock(block.mtx_);
+    if (!modifying && block.version_ == refresh.version_ &&
+        block.is_expired(refresh.file_->time_out_)) {
+      offset = block.offset_;
+      buf = shard.pool_.allocate();
+    }
+    if (!buf) {
+      // Already refreshed, invalidated, being modified or no spare buffer: the next read
+      // decides again
+      block.refreshing_ = false;
+      return;
+    }
+  }
+  shard_lock.unlock();
+
+  // Readers keep the expired copy while the new one is read into a spare buffer
+  n_refreshes_++;
+  struct fuse_file_info fi = refresh.fi_;
+  const int res = operations_.read(refresh.path_.c_str(), buf.get(), config_.block_size_,
+                                   offset, &fi);
+
+  write_lock.lock();
+  shard_lock.lock();
+  cache_iterator = shard.blocks_.find(refresh.key_);
+  if (cache_iterator == shard.blocks_.end()) {
+    return;
+  }
+  block &block = cache_iterator->second;
+  std::unique_lock block_lock(block.mtx_);
+  block.refreshing_ = false;
+  if (res < 0 || block.version_ != refresh.version_ || refresh.file_->modifying_ != 0 ||
+      refresh.file_->modifications_ != modifications) {
+    return;
+  }
+  std::swap(block.buf_, buf);
+  block.size_ = res;
+  block.timestamp_ = std::chrono::high_resolution_clock::now();
+}
+
+data_cache::cache::fetch::fetch()
+    : done_(false)
+    , result_(0)
+    , stale_(false)
+{
+}
+
+void
+data_cache::cache::fetch::complete(int result)
+{
+  std::unique_lock lock(mtx_);
+  done_ = true;
+  result_ = result;
+  lock.unlock();
+  cv_.notify_all();
+}
+
+int
+data_cache::cache::fetch::wait()
+{
+  std::unique_lock lock(mtx_);
+  cv_.wait(lock, [this] {
+    return done_;
+  });
+  return result_;
+}
+
+data_cache::cache::file::file(file_id id, struct stat &stbuf, int time_out, bool pinned)
+    : id_(id)
+    , time_out_(time_out)
+    , pinned_(pinned)
+    , handles_(0)
+    , version_(0)
+    , identity_(stbuf)
+    , size_(stbuf.st_size)
+    , locally_modified_(false)
+    , validated_(std::chrono::steady_clock::now())
+    , blocks_end_(0)
+    , n_blocks_(0)
+    , modifying_(0)
+    , modifications_(0)
+    , refreshes_(0)
+{
+}
+
+bool
+data_cache::cache::file::is_validated(int attr_time_out) const
+{
+  const auto elapsed_time = std::chrono::steady_clock::now() - validated_;
+  return attr_time_out > 0 && elapsed_time < std::chrono::seconds(attr_time_out);
+}
+
+bool
+data_cache::cache::file::revalidate(struct stat &stbuf)
+{
+  const file_identity identity(stbuf);
+
+  // Changes made through this cache are already in the blocks, any other one voids
+  // them. After a local modification the file must be as the next layer reported it
+  // then, a change of another client in between or since shows up as a difference
+  const bool replaced = identity_.ino_ != identity.ino_;
+  const bool changed =
+      locally_modified_ ? !modified_identity_ || *modified_identity_ != identity
+                        : identity_ != identity || size_ != identity.size_;
+  const bool invalidated = replaced || changed;
+  if (invalidated) {
+    version_++;
+  }
+  identity_ = identity;
+  size_ = identity.size_;
+  locally_modified_ = false;
+  modified_identity_.reset();
+  validated_ = std::chrono::steady_clock::now();
+  return invalidated;
+}
+
+void
+data_cache::cache::file::cached_block(size_t block_id)
+{
+  size_t blocks_end = blocks_end_;
+  while (blocks_end <= block_id &&
+         !blocks_end_.compare_exchange_weak(blocks_end, block_id + 1)) {
+  }
+}
+
+data_cache::cache::policies
+data_cache::cache::make_policy(const config &config)
+{
+  if (config.tinylfu_admission_) {
+    // Admission wraps a policy of keys
+    std::unique_ptr<cache_manager<key>> main;
+    switch (config.eviction_policy_) {
+    case eviction_policy::lru:
+      main = std::make_unique<lru_cache_manager<key>>();
+      break;
+    case eviction_policy::rnd:
+      main = std::make_unique<rnd_cache_manager<key>>();
+      break;
+    case eviction_policy::arc:
+      main = std::make_unique<arc_cache_manager<key>>();
+      break;
+    case eviction_policy::sampled:
+      main = std::make_unique<sampled_cache_manager<key>>();
+      break;
+    }
+    return policies(std::in_place_type<tinylfu_policy>, std::move(main));
+  }
+
+  switch (config.eviction_policy_) {
+  case eviction_policy::lru:
+    return policies(std::in_place_type<lru_policy>, config.block_size_);
+  case eviction_policy::arc:
+    return policies(std::in_place_type<arc_policy>);
+  case eviction_policy::sampled:
+    return policies(std::in_place_type<sampled_policy>);
+  case eviction_policy::rnd:
+  default:
+    return policies(std::in_place_type<rnd_policy>);
+  }
+}
+
+data_cache::cache::lru_policy::lru_policy(size_t block_size)
+    : block_size_(block_size)
+{
+}
+
+std::optional<data_cache::key>
+data_cache::cache::lru_policy::evict()
+{
+  const block *victim = lru_.evict();
+  if (victim == nullptr) {
+    return {};
+  }
+  return std::make_pair(victim->file_.id_, victim->offset_ / block_size_);
+}
+
+data_cache::cache::shard::shard(const config &config, size_t capacity)
+    : capacity_(capacity)
+    , size_(0)
+    // Overshoots the capacity by one block
+    , pool_(capacity / config.block_size_ + 1, config.block_size_, config.hugepages_)
+    , policy_(make_policy(config))
+{
+}
+
+data_cache::cache::block::block(file &file, block_pool::buffer buf, size_t size,
+                                off_t offset, uint64_t version)
+    : file_(file)
+    , buf_(std::move(buf))
     , size_(size)
     , offset_(offset)
     , timestamp_(std::chrono::high_resolution_clock::now())
-    , mtime_(mtime)
+    , version_(version)
+    , refreshing_(false)
 {
 }
 
 bool
-data_cache::cache::block::is_valid(int time_out,
-                                   struct timespec &current_file_mtime) const
+data_cache::cache::block::is_valid(int time_out, uint64_t current_file_version) const
 {
-  if (mtime_.tv_sec != current_file_mtime.tv_sec ||
-      mtime_.tv_nsec != current_file_mtime.tv_nsec) {
-    return false;
-  }
+  return version_ == current_file_version && !is_expired(time_out);
+}
 
+bool
+data_cache::cache::block::is_expired(int time_out) const
+{
   if (time_out > 0) {
     auto now = std::chrono::high_resolution_clock::now();
     auto elapsed_time =
         std::chrono::duration_cast<std::chrono::seconds>(now - timestamp_).count();
-    return elapsed_time < time_out;
+    return elapsed_time >= time_out;
   }
-  return true;
+  return false;
 }
 
 } // namespace rsafefs
\ No newline at end of file
@@ -1,9 +1,10 @@
 #include "rsafefs/layers/data_cache/data_cache.hpp"
 #include "rsafefs/layers/data_cache/cache.hpp"
-#include "rsafefs/layers/data_cache/drivers/lru.hpp"
-#include "rsafefs/layers/data_cache/drivers/rnd.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
 #include "rsafefs/utils/utils.hpp"
+#include "rsafefs/utils/warm_start.hpp"
+#include <fcntl.h>
 
 namespace rsafefs
 {
@@ -11,21 +12,88 @@ namespace rsafefs
 static fuse_operations next_layer;
 static data_cache::cache::config config;
 static data_cache::cache *cache = nullptr;
+static std::unique_ptr<utils::warm_start_prefetcher> warm_start;
+
+// Reads the blocks of a file listed by the manifest of the previous mount. Checking and
+// opening the file are paced like the reads of its blocks
+static void
+data_cache_warm_start(const utils::manifest_entry &entry,
+                      utils::warm_start_prefetcher &prefetcher)
+{
+  const char *path = entry.path_.c_str();
+  struct stat stbuf {
+  };
+  if (!prefetcher.pace() || next_layer.getattr(path, &stbuf) != 0 ||
+      !utils::is_unchanged(entry, stbuf)) {
+    return;
+  }
+
+  struct fuse_file_info fi {
+  };
+  fi.flags = O_RDONLY;
+  if (!prefetcher.pace() || cache->open(path, &fi) != 0) {
+    return;
+  }
+  std::vector<char> buf(config.block_size_);
+  for (const uint64_t block_id : entry.blocks_) {
+    if (!prefetcher.pace()) {
+      break;
+    }
+    cache->read(path, buf.data(), config.block_size_, block_id * config.block_size_, &fi);
+  }
+  cache->release(path, &fi);
+}
 
 static void *
 data_cache_init(fuse_conn_info *conn)
 {
   cache = new data_cache::cache(config, next_layer);
-  if (next_layer.init != nullptr) {
-    return next_layer.init(conn);
+  utils::memory_governor::instance().add("data_cache", cache);
+  // The prefetcher goes through the next layer, which must be ready first
+  void *private_data = next_layer.init != nullptr ? next_layer.init(conn) : nullptr;
+  if (!config.warm_start_manifest_.empty()) {
+    warm_start = std::make_unique<utils::warm_start_prefetcher>(
+        utils::load_manifest(config.warm_start_manifest_), config.warm_start_rate_,
+        data_cache_warm_start);
+    warm_start->start();
   }
-  return nullptr;
+  return private_data;
 }
 
 static void
 data_cache_destroy(void *private_data)
 {
   if (cache != nullptr) {
+    warm_start.reset();
+    if (!config.warm_start_manifest_.empty()) {
+      utils::save_manifest(config.warm_start_manifest_, cache->manifest());
+    }
+    const auto stats = cache->allocator_stats();
+    logging::debug("data cache block pool: {}/{} blocks in use ({:.1f}% utilization), "
+                   "{} in the free list ({} not resident), peak of {}, "
+                   "{} failed allocations, {} hugepage backed",
+                   stats.used_, stats.capacity_, stats.utilization() * 100,
+                   stats.free_list_length_, stats.cold_, stats.peak_used_,
+                   stats.failed_allocations_, stats.hugepages_);
+    const auto fetch_stats = cache->fetch_stats();
+    logging::debug("data cache fetches: {} blocks read from the next layer, "
+                   "{} coalesced requests, {} background refreshes, "
+                   "{} expired blocks served",
+                   fetch_stats.fetches_, fetch_stats.coalesced_, fetch_stats.refreshes_,
+                   fetch_stats.stale_serves_);
+    logging::debug("data cache reclaimer: {} blocks evicted in the background",
+                   cache->reclaimed_blocks());
+    const auto hit_stats = cache->hit_buffer_stats();
+    logging::debug("data cache hits: {} recorded for the eviction policy, "
+                   "{} dropped ({:.1f}%)",
+                   hit_stats.recorded_, hit_stats.dropped_, hit_stats.drop_rate() * 100);
+    if (const auto disk_stats = cache->disk_stats()) {
+      logging::debug("data cache disk tier: {}/{} slots in use, {} hits, {} misses, "
+                     "{} demoted blocks",
+                     disk_stats->used_, disk_stats->capacity_, disk_stats->hits_,
+                     disk_stats->misses_, disk_stats->demotions_);
+    }
+    utils::memory_governor::instance().remove(cache);
     delete cache;
     cache = nullptr;
   }
@@ -45,7 +113,37 @@ static int
 data_cache_read(const char *path, char *buf, size_t size, off_t offset,
                 struct fuse_file_info *fi)
 {
-  return cache->read(path, buf, size, offset, fi);
+  const int res = cache->read(path, buf, size, offset, fi);
+  utils::memory_governor::instance().balance_if_due();
+  return res;
+}
+
+static int
+data_cache_write(const char *path, const char *buf, size_t size, off_t offset,
+                 struct fuse_file_info *fi)
+{
+  const int res = cache->write(path, buf, size, offset, fi);
+  utils::memory_governor::instance().balance_if_due();
+  return res;
+}
+
+static int
+data_cache_truncate(const char *path, off_t size)
+{
+  return cache->truncate(path, size);
+}
+
+static int
+data_cache_ftruncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+  return cache->ftruncate(path, size, fi);
+}
+
+static int
+data_cache_fallocate(const char *path, int mode, off_t offset, off_t length,
+                     struct fuse_file_info *fi)
+{
+  return cache->fallocate(path, mode, offset, length, fi);
 }
 
 static int
@@ -59,11 +157,25 @@ data_cache_config::data_cache_config(YAML::Node data)
   logging::debug("configuring data caching layer...");
 
   // Default configuration
+  using policy = data_cache::cache::eviction_policy;
   config.size_ = 1UL * 1024UL * 1024UL * 1024UL; // 1 GiB
   config.block_size_ = 16UL * 1024UL;            // 16 KiB
+  config.shards_ = 16;                           // 16 independently locked shards
+  config.max_fetch_blocks_ = 64;                 // up to 64 missing blocks per read
+  config.hugepages_ = false;                     // regular pages for the block pool
   config.time_out_ = 30;                         // 30 seconds
-  config.eviction_policy_ =
-      std::make_shared<data_cache::rnd_eviction>(); // random eviction
+  config.attr_time_out_ = 0;                     // every open checks the attributes
+  config.disk_directory_ = "";                   // no disk tier
+  config.disk_size_ = 16UL << 30;                // 16 GiB
+  config.stale_while_revalidate_ = false;        // expired blocks are read again
+  config.refresh_workers_ = 2;                   // background refresh threads
+  config.high_watermark_ = 1.0;                  // misses evict at the capacity
+  config.low_watermark_ = 0.8;                   // once enabled, down to 80%
+  config.warm_start_manifest_ = "";              // no warm start
+  config.warm_start_rate_ = 256;                 // 256 requests a second
+  config.rules_ = {};                            // same policy for every path
+  config.eviction_policy_ = policy::rnd;         // random eviction
+  config.tinylfu_admission_ = false;             // every missed block is cached
 
   parser_.emplace("size", [&]() {
     config.size_ = data["size"].as<size_t>();
@@ -73,21 +185,102 @@ data_cache_config::data_cache_config(YAML::Node data)
     config.block_size_ = data["block_size"].as<size_t>();
   });
 
+  parser_.emplace("shards", [&]() {
+    config.shards_ = data["shards"].as<size_t>();
+    if (config.shards_ == 0) {
+      throw data_cache_wrong_config_exception("number of shards must be greater than 0");
+    }
+  });
+
+  parser_.emplace("max_fetch_blocks", [&]() {
+    config.max_fetch_blocks_ = data["max_fetch_blocks"].as<size_t>();
+    if (config.max_fetch_blocks_ == 0) {
+      throw data_cache_wrong_config_exception(
+          "maximum number of fetched blocks must be greater than 0");
+    }
+  });
+
+  parser_.emplace("hugepages", [&]() {
+    config.hugepages_ = data["hugepages"].as<bool>();
+  });
+
   parser_.emplace("time_out", [&]() {
     config.time_out_ = data["time_out"].as<int>();
   });
 
+  parser_.emplace("attr_time_out", [&]() {
+    config.attr_time_out_ = data["attr_time_out"].as<int>();
+  });
+
+  parser_.emplace("disk_directory", [&]() {
+    config.disk_directory_ = data["disk_directory"].as<std::string>();
+  });
+
+  parser_.emplace("disk_size", [&]() {
+    config.disk_size_ = data["disk_size"].as<size_t>();
+  });
+
+  parser_.emplace("stale_while_revalidate", [&]() {
+    config.stale_while_revalidate_ = data["stale_while_revalidate"].as<bool>();
+  });
+
+  parser_.emplace("refresh_workers", [&]() {
+    config.refresh_workers_ = data["refresh_workers"].as<size_t>();
+    if (config.refresh_workers_ == 0) {
+      throw data_cache_wrong_config_exception(
+          "number of refresh workers must be greater than 0");
+    }
+  });
+
+  parser_.emplace("high_watermark", [&]() {
+    config.high_watermark_ = data["high_watermark"].as<double>();
+  });
+
+  parser_.emplace("low_watermark", [&]() {
+    config.low_watermark_ = data["low_watermark"].as<double>();
+  });
+
+  parser_.emplace("warm_start_manifest", [&]() {
+    config.warm_start_manifest_ = data["warm_start_manifest"].as<std::string>();
+  });
+
+  parser_.emplace("warm_start_rate", [&]() {
+    config.warm_start_rate_ = data["warm_start_rate"].as<size_t>();
+    if (config.warm_start_rate_ == 0) {
+      throw data_cache_wrong_config_exception("warm start rate must be greater than 0");
+    }
+  });
+
+  parser_.emplace("rules", [&]() {
+    config.rules_ = utils::parse_path_rules(data["rules"]);
+  });
+
   parser_.emplace("eviction_policy", [&]() {
     const std::string eviction_policy = data["eviction_policy"].as<std::string>();
     if (eviction_policy == "lru") {
-      config.eviction_policy_ = std::make_shared<data_cache::lru_eviction>();
+      config.eviction_policy_ = policy::lru;
     } else if (eviction_policy == "rnd") {
-      config.eviction_policy_ = std::make_shared<data_cache::rnd_eviction>();
+      config.eviction_policy_ = policy::rnd;
+    } else if (eviction_policy == "arc") {
+      config.eviction_policy_ = policy::arc;
+    } else if (eviction_policy == "sampled") {
+      config.eviction_policy_ = policy::sampled;
     } else {
       throw data_cache_wrong_config_exception("invalid replacement policy");
     }
   });
 
+  parser_.emplace("admission", [&]() {
+    const std::string admission = data["admission"].as<std::string>();
+    if (admission == "tinylfu") {
+      config.tinylfu_admission_ = true;
+    } else if (admission == "none") {
+      config.tinylfu_admission_ = false;
+    } else {
+      throw data_cache_wrong_config_exception("invalid admission policy");
+    }
+  });
+
   for (const auto &kv : data) {
     const std::string &option = kv.first.as<std::string>();
     if (parser_.contains(option)) {
@@ -97,6 +290,13 @@ data_cache_config::data_cache_config(YAML::Node data)
                     option);
     }
   }
+
+  // Checked once both watermarks are known, in any order of the options
+  if (config.high_watermark_ <= 0.0 || config.high_watermark_ > 1.0 ||
+      config.low_watermark_ <= 0.0 || config.low_watermark_ > config.high_watermark_) {
+    throw data_cache_wrong_config_exception(
+        "watermarks must satisfy 0 < low_watermark <= high_watermark <= 1");
+  }
 }
 
 data_cache_config::~data_cache_config() {}
@@ -115,6 +315,13 @@ data_cache_config::init_layer(fuse_operations &operations)
   utils::stack_operation(data_cache_open, operations.open);
   utils::stack_operation(data_cache_read, operations.read);
   utils::stack_operation(data_cache_release, operations.release);
+  utils::stack_operation(data_cache_write, operations.write);
+  utils::stack_operation(data_cache_truncate, operations.truncate);
+  utils::stack_operation(data_cache_ftruncate, operations.ftruncate);
+  // Not every layer implements fallocate, the cache only follows it when it is there
+  if (operations.fallocate != nullptr) {
+    utils::stack_operation(data_cache_fallocate, operations.fallocate);
+  }
 }
 
 void
@@ -0,0 +1,362 @@
+#include "rsafefs/layers/data_cache/disk_tier.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <system_error>
+#include <unistd.h>
+
+namespace rsafefs
+{
+
+static constexpr uint64_t index_magic = 0x3278646e69736672; // "rfsindx2"
+static constexpr uint64_t index_format = 1;
+
+namespace
+{
+
+struct index_header {
+  uint64_t magic_;
+  uint64_t format_;
+  uint64_t block_size_;
+  uint64_t n_slots_;
+  uint64_t n_records_;
+};
+
+struct index_record {
+  uint64_t ino_;
+  int64_t mtime_sec_;
+  int64_t mtime_nsec_;
+  int64_t ctime_sec_;
+  int64_t ctime_nsec_;
+  int64_t size_;
+  uint64_t block_id_;
+  uint64_t slot_;
+  uint64_t bytes_;
+};
+
+} // namespace
+
+data_cache::file_identity::file_identity(const struct stat &stbuf)
+    : ino_(stbuf.st_ino)
+#ifdef __APPLE__
+    , mtime_(stbuf.st_mtimespec)
+    , ctime_(stbuf.st_ctimespec)
+#else
+    , mtime_(stbuf.st_mtim)
+    , ctime_(stbuf.st_ctim)
+#endif
+    , size_(stbuf.st_size)
+{
+}
+
+bool
+data_cache::file_identity::operator==(const file_identity &other) const
+{
+  return ino_ == other.ino_ && mtime_.tv_sec == other.mtime_.tv_sec &&
+         mtime_.tv_nsec == other.mtime_.tv_nsec && ctime_.tv_sec == other.ctime_.tv_sec &&
+         ctime_.tv_nsec == other.ctime_.tv_nsec && size_ == other.size_;
+}
+
+data_cache::disk_tier::disk_tier(const std::string &directory, size_t size,
+                                 size_t block_size)
+    : blocks_path_(directory + "/blocks")
+    , index_path_(directory + "/index")
+    , block_size_(block_size)
+    , n_slots_(size / block_size)
+    , fd_(-1)
+    , generations_(n_slots_, 0)
+    , n_hits_(0)
+    , n_misses_(0)
+    , n_demotions_(0)
+{
+  fd_ = ::open(blocks_path_.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "data cache: unable to open " + blocks_path_);
+  }
+
+  // Reserve the whole file upfront, demotions never have to grow it
+  const off_t file_size = static_cast<off_t>(n_slots_ * block_size_);
+  int res = posix_fallocate(fd_, 0, file_size);
+  if (res != 0 && ftruncate(fd_, file_size) != 0) {
+    res = errno;
+    ::close(fd_);
+    throw std::system_error(res, std::generic_category(),
+                            "data cache: unable to allocate " + blocks_path_);
+  }
+
+  load_index();
+}
+
+data_cache::disk_tier::~disk_tier()
+{
+  save_index();
+  ::close(fd_);
+}
+
+bool
+data_cache::disk_tier::contains(const file_identity &identity, size_t block_id)
+{
+  std::unique_lock lock(mtx_);
+  const auto files_iterator = files_.find(identity.ino_);
+  return files_iterator != files_.end() && files_iterator->second.identity_ == identity &&
+         files_iterator->second.blocks_.contains(block_id);
+}
+
+std::optional<size_t>
+data_cache::disk_tier::get(const file_identity &identity, size_t block_id, char *buf)
+{
+  std::unique_lock lock(mtx_);
+  const auto files_iterator = files_.find(identity.ino_);
+  if (files_iterator == files_.end()) {
+    n_misses_++;
+    return {};
+  }
+  if (files_iterator->second.identity_ != identity) {
+    // The file changed since its blocks were stored
+    drop_file(identity.ino_);
+    n_misses_++;
+    return {};
+  }
+  const auto blocks_iterator = files_iterator->second.blocks_.find(block_id);
+  if (blocks_iterator == files_iterator->second.blocks_.end()) {
+    n_misses_++;
+    return {};
+  }
+  const slot slot = blocks_iterator->second;
+  const uint64_t generation = generations_[slot.slot_];
+  lock.unlock();
+
+  const ssize_t res = pread(fd_, buf, slot.size_, slot.slot_ * block_size_);
+
+  lock.lock();
+  if (res != static_cast<ssize_t>(slot.size_) || generations_[slot.slot_] != generation) {
+    // Failed, or the slot was handed to another block while it was read
+    n_misses_++;
+    return {};
+  }
+  eviction_policy_.touch(std::make_pair(identity.ino_, block_id));
+  n_hits_++;
+  return slot.size_;
+}
+
+void
+data_cache::disk_tier::put(const file_identity &identity, size_t block_id,
+                           const char *buf, size_t size)
+{
+  std::unique_lock lock(mtx_);
+  const auto slot_id = allocate_slot();
+  if (!slot_id) {
+    return;
+  }
+  generations_[slot_id.value()]++;
+  lock.unlock();
+
+  // The block is only indexed once the slot holds it
+  const ssize_t res = pwrite(fd_, buf, size, slot_id.value() * block_size_);
+
+  lock.lock();
+  if (res != static_cast<ssize_t>(size)) {
+    free_slots_.push_back(slot_id.value());
+    return;
+  }
+
+  const auto stale_iterator = files_.find(identity.ino_);
+  if (stale_iterator != files_.end() && stale_iterator->second.identity_ != identity) {
+    drop_file(identity.ino_);
+  }
+  file &file = files_[identity.ino_];
+  file.identity_ = identity;
+  if (file.blocks_.contains(block_id)) {
+    drop_block(file, identity.ino_, block_id);
+  }
+  file.blocks_.emplace(block_id, slot{.slot_ = slot_id.value(), .size_ = size});
+  eviction_policy_.touch(std::make_pair(identity.ino_, block_id));
+  n_demotions_++;
+}
+
+void
+data_cache::disk_tier::remove(ino_t ino, size_t first_block_id, size_t end_block_id)
+{
+  std::unique_lock lock(mtx_);
+  const auto files_iterator = files_.find(ino);
+  if (files_iterator == files_.end()) {
+    return;
+  }
+
+  file &file = files_iterator->second;
+  std::vector<size_t> block_ids;
+  for (const auto &[block_id, slot] : file.blocks_) {
+    if (block_id >= first_block_id && block_id < end_block_id) {
+      block_ids.push_back(block_id);
+    }
+  }
+  for (const size_t block_id : block_ids) {
+    drop_block(file, ino, block_id);
+  }
+  if (file.blocks_.empty()) {
+    files_.erase(files_iterator);
+  }
+}
+
+data_cache::disk_tier::stats
+data_cache::disk_tier::get_stats()
+{
+  std::unique_lock lock(mtx_);
+  return {
+      .capacity_ = n_slots_,
+      .used_ = n_slots_ - free_slots_.size(),
+      .hits_ = n_hits_,
+      .misses_ = n_misses_,
+      .demotions_ = n_demotions_,
+  };
+}
+
+void
+data_cache::disk_tier::drop_block(file &file, ino_t ino, size_t block_id)
+{
+  const auto blocks_iterator = file.blocks_.find(block_id);
+  free_slots_.push_back(blocks_iterator->second.slot_);
+  generations_[blocks_iterator->second.slot_]++;
+  file.blocks_.erase(blocks_iterator);
+  eviction_policy_.remove(std::make_pair(ino, block_id));
+}
+
+void
+data_cache::disk_tier::drop_file(ino_t ino)
+{
+  const auto files_iterator = files_.find(ino);
+  for (const auto &[block_id, slot] : files_iterator->second.blocks_) {
+    free_slots_.push_back(slot.slot_);
+    generations_[slot.slot_]++;
+    eviction_policy_.remove(std::make_pair(ino, block_id));
+  }
+  files_.erase(files_iterator);
+}
+
+std::optional<size_t>
+data_cache::disk_tier::allocate_slot()
+{
+  if (free_slots_.empty()) {
+    const auto victim = eviction_policy_.evict();
+    if (!victim) {
+      // Every slot is being written
+      return {};
+    }
+    const auto files_iterator = files_.find(victim->first);
+    file &file = files_iterator->second;
+    const auto blocks_iterator = file.blocks_.find(victim->second);
+    const size_t slot = blocks_iterator->second.slot_;
+    file.blocks_.erase(blocks_iterator);
+    if (file.blocks_.empty()) {
+      files_.erase(files_iterator);
+    }
+    return slot;
+  }
+
+  const size_t slot = free_slots_.back();
+  free_slots_.pop_back();
+  return slot;
+}
+
+void
+data_cache::disk_tier::load_index()
+{
+  std::ifstream index(index_path_, std::ios::binary);
+  // A crash leaves the slots out of sync with any saved index, only a clean shutdown
+  // writes a new one
+  std::remove(index_path_.c_str());
+
+  std::vector<bool> used(n_slots_, false);
+  index_header header{};
+  if (index.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+      header.magic_ == index_magic && header.format_ == index_format &&
+      header.block_size_ == block_size_ && header.n_slots_ == n_slots_) {
+    index_record record{};
+    for (uint64_t i = 0; i < header.n_records_ &&
+                         index.read(reinterpret_cast<char *>(&record), sizeof(record));
+         i++) {
+      if (record.slot_ >= n_slots_ || used[record.slot_] || record.bytes_ > block_size_) {
+        continue;
+      }
+
+      file_identity identity{};
+      identity.ino_ = record.ino_;
+      identity.mtime_.tv_sec = record.mtime_sec_;
+      identity.mtime_.tv_nsec = record.mtime_nsec_;
+      identity.ctime_.tv_sec = record.ctime_sec_;
+      identity.ctime_.tv_nsec = record.ctime_nsec_;
+      identity.size_ = record.size_;
+
+      auto [files_iterator, inserted] = files_.try_emplace(identity.ino_);
+      if (!inserted && files_iterator->second.identity_ != identity) {
+        continue;
+      }
+      files_iterator->second.identity_ = identity;
+      files_iterator->second.blocks_.emplace(
+          record.block_id_, slot{.slot_ = record.slot_, .size_ = record.bytes_});
+      eviction_policy_.touch(std::make_pair(identity.ino_, record.block_id_));
+      used[record.slot_] = true;
+    }
+  } else if (index.is_open()) {
+    logging::warn("data cache: ignoring the index at {}, it doesn't match the tier",
+                  index_path_);
+  }
+
+  free_slots_.reserve(n_slots_);
+  for (size_t i = n_slots_; i > 0; i--) {
+    if (!used[i - 1]) {
+      free_slots_.push_back(i - 1);
+    }
+  }
+}
+
+void
+data_cache::disk_tier::save_index()
+{
+  std::unique_lock lock(mtx_);
+  const std::string tmp_path = index_path_ + ".tmp";
+  std::ofstream index(tmp_path, std::ios::binary | std::ios::trunc);
+
+  uint64_t n_records = 0;
+  for (const auto &[ino, file] : files_) {
+    n_records += file.blocks_.size();
+  }
+  index_header header{
+      .magic_ = index_magic,
+      .format_ = index_format,
+      .block_size_ = block_size_,
+      .n_slots_ = n_slots_,
+      .n_records_ = n_records,
+  };
+  index.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto &[ino, file] : files_) {
+    for (const auto &[block_id, slot] : file.blocks_) {
+      const index_record record{
+          .ino_ = ino,
+          .mtime_sec_ = file.identity_.mtime_.tv_sec,
+          .mtime_nsec_ = file.identity_.mtime_.tv_nsec,
+          .ctime_sec_ = file.identity_.ctime_.tv_sec,
+          .ctime_nsec_ = file.identity_.ctime_.tv_nsec,
+          .size_ = file.identity_.size_,
+          .block_id_ = block_id,
+          .slot_ = slot.slot_,
+          .bytes_ = slot.size_,
+      };
+      index.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+  }
+  index.close();
+
+  // Make sure the slots are on disk before the index that points to them
+  if (!index || fsync(fd_) != 0 ||
+      std::rename(tmp_path.c_str(), index_path_.c_str()) != 0) {
+    logging::warn("data cache: unable to save the index at {}", index_path_);
+    std::remove(tmp_path.c_str());
+  }
+}
+
+} // namespace rsafefs
@@ -9,6 +9,7 @@ namespace rsafefs
 
 local_config::local_config(YAML::Node data)
     : mode_(LOCAL)
+    , readdir_plus_(false)
 {
   logging::debug("configuring local layer...");
 
@@ -35,6 +36,10 @@ local_config::local_config(YAML::Node data)
     }
   });
 
+  parser_.emplace("readdir_plus", [&]() {
+    readdir_plus_ = data["readdir_plus"].as<bool>();
+  });
+
   for (const auto &kv : data) {
     const std::string &option = kv.first.as<std::string>();
     if (parser_.contains(option)) {
@@ -54,10 +59,10 @@ local_config::init_layer(fuse_operations &operations)
 
   switch (mode_) {
   case mode::NFS:
-    assign_nfs_operations(operations, path_);
+    assign_nfs_operations(operations, path_, readdir_plus_);
     break;
   default:
-    assign_local_operations(operations, path_);
+    assign_local_operations(operations, path_, readdir_plus_);
   }
 }
 
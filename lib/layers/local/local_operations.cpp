@@ -27,6 +27,7 @@ namespace rsafefs
 {
 
 static std::string root_path;
+static bool readdir_plus = false;
 
 static void *
 local_init(fuse_conn_info *conn)
@@ -441,9 +442,13 @@ local_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
       }
     }
 
-    memset(&st, 0, sizeof(st));
-    st.st_ino = d->entry->d_ino;
-    st.st_mode = d->entry->d_type << 12;
+    // Entries removed since they were read only get what readdir knows
+    if (!readdir_plus ||
+        fstatat(dirfd(d->dp), d->entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      memset(&st, 0, sizeof(st));
+      st.st_ino = d->entry->d_ino;
+      st.st_mode = d->entry->d_type << 12;
+    }
     nextoff = telldir(d->dp);
     if (filler(buf, d->entry->d_name, &st, nextoff)) {
       break;
@@ -470,9 +475,11 @@ local_releasedir(const char *path, struct fuse_file_info *fi)
 }
 
 void
-assign_local_operations(fuse_operations &operations, const std::string &path)
+assign_local_operations(fuse_operations &operations, const std::string &path,
+                        bool readdir_plus_enabled)
 {
   root_path = path;
+  readdir_plus = readdir_plus_enabled;
 
   operations.init = local_init;
   operations.destroy = local_destroy;
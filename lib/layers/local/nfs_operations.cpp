@@ -8,6 +8,7 @@
 #include <cerrno>
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
 #include <memory>
 #include <mutex>
@@ -32,6 +33,7 @@ namespace rsafefs
 namespace fs = std::filesystem;
 
 static std::string root_path;
+static bool readdir_plus = false;
 
 static inline int
 sync_path(const char *path)
@@ -153,11 +155,15 @@ nfs_readdir([[maybe_unused]] const char *path, void *buf, fuse_fill_dir_t filler
         break;
     }
 
+    // Entries removed since they were read only get what readdir knows
     struct stat st {
     };
-    memset(&st, 0, sizeof(st));
-    st.st_ino = d->entry->d_ino;
-    st.st_mode = d->entry->d_type << 12;
+    if (!readdir_plus ||
+        fstatat(dirfd(d->dir_ptr), d->entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      memset(&st, 0, sizeof(st));
+      st.st_ino = d->entry->d_ino;
+      st.st_mode = d->entry->d_type << 12;
+    }
 
     const off_t nextoff = telldir(d->dir_ptr);
     if (filler(buf, d->entry->d_name, &st, nextoff))
@@ -506,9 +512,11 @@ nfs_fsync([[maybe_unused]] const char *path, int isdatasync, struct fuse_file_in
 }
 
 void
-assign_nfs_operations(fuse_operations &operations, const std::string &path)
+assign_nfs_operations(fuse_operations &operations, const std::string &path,
+                      bool readdir_plus_enabled)
 {
   root_path = path;
+  readdir_plus = readdir_plus_enabled;
 
   operations.init = nfs_init;
   operations.destroy = nfs_destroy;
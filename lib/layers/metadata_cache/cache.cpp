@@ -1,79 +1,387 @@
 #include "rsafefs/layers/metadata_cache/cache.hpp"
+#include <algorithm>
 
 namespace rsafefs
 {
 
+// Whether something cached at `timestamp` is still valid, a time out of 0 never expires
+static bool
+is_within(std::chrono::high_resolution_clock::time_point timestamp, int time_out)
+{
+  if (time_out > 0) {
+    auto now = std::chrono::high_resolution_clock::now();
+    auto elapsed_time =
+        std::chrono::duration_cast<std::chrono::seconds>(now - timestamp).count();
+    return elapsed_time < time_out;
+  }
+  return true;
+}
+
 metadata_cache::cache::cache(config &config)
-    : config_(config)
+    : time_out_(config.time_out_)
+    , negative_enabled_(config.negative_size_ > 0)
+    , negative_time_out_(config.negative_time_out_)
+    , listing_capacity_(config.dir_size_)
+    , listings_(listing_capacity_, listing_size{}, is_fresh{})
+    , rules_(config.rules_)
 {
+  // Rounded up, so the shards hold at least size_ entries together
+  const size_t shard_capacity = (config.size_ + config.shards_ - 1) / config.shards_;
+  const size_t negative_capacity =
+      (config.negative_size_ + config.shards_ - 1) / config.shards_;
+  shards_.reserve(config.shards_);
+  for (size_t i = 0; i < config.shards_; i++) {
+    shards_.push_back(std::make_unique<shard>(config, shard_capacity, negative_capacity));
+  }
 }
 
 void
 metadata_cache::cache::put(const std::string &path, struct stat *stbuf)
 {
-  std::unique_lock lock(mtx_);
-
-  const auto cache_size = cache_.size();
-  if (cache_size >= config_.size_) {
-    std::optional<std::string> selected_path = config_.eviction_policy_->evict();
-    if (selected_path) {
-      cache_.erase(selected_path.value());
-    }
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule == nullptr) {
+    std::visit([&](auto &engine) { engine.put(path, metadata(stbuf, time_out_)); },
+               shard_of(path).engine_);
+    return;
+  }
+  if (rule->bypass_) {
+    return;
   }
 
-  cache_.emplace(path, stbuf);
-  config_.eviction_policy_->touch(path);
+  const int time_out = rule->time_out_.value_or(time_out_);
+  if (rule->pin_) {
+    std::unique_lock lock(pinned_mtx_);
+    pinned_.insert_or_assign(path, metadata(stbuf, time_out));
+    return;
+  }
+  std::visit([&](auto &engine) { engine.put(path, metadata(stbuf, time_out)); },
+             shard_of(path).engine_);
 }
 
 bool
 metadata_cache::cache::get(const std::string &path, struct stat *stbuf)
 {
-  std::shared_lock shared_lock(mtx_);
-
-  const auto cache_iterator = cache_.find(path);
-  if (cache_iterator == cache_.end()) {
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule != nullptr && rule->bypass_) {
     return false;
   }
+  if (rule != nullptr && rule->pin_) {
+    // Expired entries are left for the next put to replace
+    std::shared_lock lock(pinned_mtx_);
+    const auto pinned_iterator = pinned_.find(path);
+    if (pinned_iterator == pinned_.end() || !pinned_iterator->second.is_valid()) {
+      return false;
+    }
+    *stbuf = pinned_iterator->second.stbuf_;
+    return true;
+  }
+
+  // The attributes are copied straight out of the entry
+  const auto copy = [&](const metadata &metadata) { *stbuf = metadata.stbuf_; };
+  return std::visit([&](auto &engine) { return engine.read(path, copy); },
+                    shard_of(path).engine_);
+}
+
+void
+metadata_cache::cache::remove(const std::string &path)
+{
+  shard &shard = shard_of(path);
+  if (negative_enabled_) {
+    shard.negatives_.remove(path);
+  }
+  if (listing_capacity_ > 0) {
+    listings_.remove(path);
+  }
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule != nullptr && rule->pin_) {
+    std::unique_lock lock(pinned_mtx_);
+    pinned_.erase(path);
+    return;
+  }
+  std::visit([&](auto &engine) { engine.remove(path); }, shard.engine_);
+}
 
-  metadata metadata = cache_.at(path);
-  if (!metadata.is_valid(config_.time_out_)) {
-    shared_lock.unlock();
+void
+metadata_cache::cache::put_negative(const std::string &path)
+{
+  if (!negative_enabled_) {
+    return;
+  }
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule != nullptr && rule->bypass_) {
+    return;
+  }
+  shard_of(path).negatives_.put(path, negative(negative_time_out_));
+}
 
-    std::unique_lock lock(mtx_);
-    cache_.erase(path);
-    config_.eviction_policy_->remove(path);
+bool
+metadata_cache::cache::get_negative(const std::string &path)
+{
+  if (!negative_enabled_) {
     return false;
   }
+  return shard_of(path).negatives_.read(path, [](const negative &) {});
+}
 
-  *stbuf = metadata.stbuf_;
-  config_.eviction_policy_->touch(path);
-  return true;
+void
+metadata_cache::cache::remove_negative(const std::string &path)
+{
+  if (!negative_enabled_) {
+    return;
+  }
+  shard_of(path).negatives_.remove(path);
 }
 
 void
-metadata_cache::cache::remove(const std::string &path)
+metadata_cache::cache::remove_negatives_under(const std::string &path)
+{
+  if (!negative_enabled_) {
+    return;
+  }
+  const std::string prefix = path.ends_with('/') ? path : path + '/';
+  for (auto &shard : shards_) {
+    shard->negatives_.remove_if([&](const key &negative_path, const negative &) {
+      return negative_path.starts_with(prefix);
+    });
+  }
+}
+
+void
+metadata_cache::cache::put_listing(const std::string &path,
+                                   std::shared_ptr<const listing> listing)
+{
+  if (listing->entries_.size() >= listing_capacity_) {
+    return;
+  }
+  const utils::path_rule *rule = rules_.match(path);
+  if (rule != nullptr && rule->bypass_) {
+    return;
+  }
+  const int time_out = rule != nullptr ? rule->time_out_.value_or(time_out_) : time_out_;
+  listings_.put(path, cached_listing(std::move(listing), time_out));
+}
+
+std::shared_ptr<const metadata_cache::cache::listing>
+metadata_cache::cache::get_listing(const std::string &path)
+{
+  if (listing_capacity_ == 0) {
+    return nullptr;
+  }
+  // Only the pointer is copied, the listing is shared with the readers still using it
+  std::shared_ptr<const listing> listing;
+  listings_.read(path, [&](const cached_listing &cached) { listing = cached.listing_; });
+  return listing;
+}
+
+read_buffer_stats
+metadata_cache::cache::hit_buffer_stats() const
+{
+  read_buffer_stats stats{};
+  for (const auto &shard : shards_) {
+    const read_buffer_stats shard_stats =
+        std::visit([](const auto &engine) { return engine.hit_buffer_stats(); },
+                   shard->engine_);
+    stats.recorded_ += shard_stats.recorded_;
+    stats.dropped_ += shard_stats.dropped_;
+  }
+  return stats;
+}
+
+std::vector<utils::manifest_entry>
+metadata_cache::cache::manifest() const
+{
+  std::vector<std::pair<std::chrono::high_resolution_clock::time_point,
+                        utils::manifest_entry>>
+      entries;
+  const auto add = [&](const key &path, const metadata &metadata) {
+    entries.emplace_back(metadata.timestamp_,
+                         utils::manifest_entry{
+                             .path_ = path,
+                             .mtime_ = utils::mtime_of(metadata.stbuf_),
+                             .size_ = metadata.stbuf_.st_size,
+                             .blocks_ = {},
+                         });
+  };
+  for (const auto &shard : shards_) {
+    std::visit([&](const auto &engine) { engine.for_each(add); }, shard->engine_);
+  }
+  std::shared_lock pinned_lock(pinned_mtx_);
+  for (const auto &[path, metadata] : pinned_) {
+    add(path, metadata);
+  }
+  pinned_lock.unlock();
+
+  std::sort(entries.begin(), entries.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+  std::vector<utils::manifest_entry> manifest;
+  manifest.reserve(entries.size());
+  for (auto &[timestamp, entry] : entries) {
+    manifest.push_back(std::move(entry));
+  }
+  return manifest;
+}
+
+size_t
+metadata_cache::cache::memory_usage() const
+{
+  size_t bytes = 0;
+  for (const auto &shard : shards_) {
+    const size_t entries =
+        std::visit([](const auto &engine) { return engine.size(); }, shard->engine_);
+    bytes += entries * entry_bytes;
+    bytes += shard->negatives_.size() * negative_entry_bytes;
+  }
+  bytes += listings_.size() * listing_entry_bytes;
+  return bytes;
+}
+
+size_t
+metadata_cache::cache::memory_hits() const
+{
+  const read_buffer_stats stats = hit_buffer_stats();
+  return stats.recorded_ + stats.dropped_;
+}
+
+template <typename F>
+size_t
+metadata_cache::cache::shrink_shards(size_t amount, F &&shrink_shard)
+{
+  // Every shard gives back its share, the ones left short are made up by the others
+  size_t released = 0;
+  bool evicted = true;
+  while (released < amount && evicted) {
+    evicted = false;
+    const size_t share = (amount - released + shards_.size() - 1) / shards_.size();
+    for (auto &shard : shards_) {
+      const size_t shard_released =
+          shrink_shard(*shard, std::min(share, amount - released));
+      released += shard_released;
+      evicted = evicted || shard_released > 0;
+      if (released >= amount) {
+        break;
+      }
+    }
+  }
+  return released;
+}
+
+size_t
+metadata_cache::cache::shrink(size_t bytes)
+{
+  const auto shrink_negatives = [](shard &shard, size_t amount) {
+    return shard.negatives_.shrink(amount);
+  };
+  const auto shrink_attributes = [](shard &shard, size_t amount) {
+    return std::visit([&](auto &engine) { return engine.shrink(amount); }, shard.engine_);
+  };
+
+  // Negative entries go first, losing one only costs a probe of a missing path. Then
+  // listings, whose entries are smaller than attributes
+  size_t released = 0;
+  const auto units_left = [&](size_t unit_bytes) {
+    return (bytes - released + unit_bytes - 1) / unit_bytes;
+  };
+  released += shrink_shards(units_left(negative_entry_bytes), shrink_negatives) *
+              negative_entry_bytes;
+  if (released < bytes) {
+    released += listings_.shrink(units_left(listing_entry_bytes)) * listing_entry_bytes;
+  }
+  if (released < bytes) {
+    released += shrink_shards(units_left(entry_bytes), shrink_attributes) * entry_bytes;
+  }
+  return released;
+}
+
+metadata_cache::cache::shard &
+metadata_cache::cache::shard_of(const key &path) const
+{
+  return *shards_[absl::Hash<key>{}(path) % shards_.size()];
+}
+
+metadata_cache::cache::engines
+metadata_cache::cache::make_engine(const config &config, size_t capacity)
 {
-  std::unique_lock lock(mtx_);
-  cache_.erase(path);
-  config_.eviction_policy_->remove(path);
+  const is_fresh is_fresh{};
+  const common::unit_size<metadata> unit_size{};
+
+  if (config.tinylfu_admission_) {
+    // Admission wraps a policy of keys
+    std::unique_ptr<cache_manager<key>> main;
+    switch (config.eviction_policy_) {
+    case eviction_policy::lru:
+      main = std::make_unique<lru_cache_manager<key>>();
+      break;
+    case eviction_policy::rnd:
+      main = std::make_unique<rnd_cache_manager<key>>();
+      break;
+    case eviction_policy::arc:
+      main = std::make_unique<arc_cache_manager<key>>();
+      break;
+    case eviction_policy::sampled:
+      main = std::make_unique<sampled_cache_manager<key>>();
+      break;
+    }
+    return engines(std::in_place_type<tinylfu_engine>, capacity, unit_size, is_fresh,
+                   std::move(main));
+  }
+
+  switch (config.eviction_policy_) {
+  case eviction_policy::lru:
+    return engines(std::in_place_type<lru_engine>, capacity, unit_size, is_fresh);
+  case eviction_policy::arc:
+    return engines(std::in_place_type<arc_engine>, capacity, unit_size, is_fresh);
+  case eviction_policy::sampled:
+    return engines(std::in_place_type<sampled_engine>, capacity, unit_size, is_fresh);
+  case eviction_policy::rnd:
+  default:
+    return engines(std::in_place_type<rnd_engine>, capacity, unit_size, is_fresh);
+  }
 }
 
-metadata_cache::cache::metadata::metadata(struct stat *stbuf)
+metadata_cache::cache::metadata::metadata(struct stat *stbuf, int time_out)
     : stbuf_(*stbuf)
     , timestamp_(std::chrono::high_resolution_clock::now())
+    , time_out_(time_out)
 {
 }
 
 bool
-metadata_cache::cache::metadata::is_valid(int time_out) const
+metadata_cache::cache::metadata::is_valid() const
+{
+  return is_within(timestamp_, time_out_);
+}
+
+metadata_cache::cache::negative::negative(int time_out)
+    : timestamp_(std::chrono::high_resolution_clock::now())
+    , time_out_(time_out)
+{
+}
+
+bool
+metadata_cache::cache::negative::is_valid() const
+{
+  return is_within(timestamp_, time_out_);
+}
+
+metadata_cache::cache::cached_listing::cached_listing(
+    std::shared_ptr<const listing> listing, int time_out)
+    : listing_(std::move(listing))
+    , timestamp_(std::chrono::high_resolution_clock::now())
+    , time_out_(time_out)
+{
+}
+
+bool
+metadata_cache::cache::cached_listing::is_valid() const
+{
+  return is_within(timestamp_, time_out_);
+}
+
+metadata_cache::cache::shard::shard(const config &config, size_t capacity,
+                                    size_t negative_capacity)
+    : engine_(make_engine(config, capacity))
+    , negatives_(negative_capacity, common::unit_size<negative>{}, is_fresh{})
 {
-  if (time_out > 0) {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto elapsed_time =
-        std::chrono::duration_cast<std::chrono::seconds>(now - timestamp_).count();
-    return elapsed_time < time_out;
-  }
-  return true;
 }
 
-} // namespace rsafefs
\ No newline at end of file
+} // namespace rsafefs
@@ -0,0 +1,177 @@
+#include "rsafefs/layers/metadata_cache/children_prefetcher.hpp"
+#include "rsafefs/utils/bulk_getattr.hpp"
+#include <absl/hash/hash.h>
+#include <algorithm>
+#include <string_view>
+
+namespace rsafefs
+{
+
+// Directory holding the entry at `path`
+static std::string
+parent_of(std::string_view path)
+{
+  const size_t last_slash = path.find_last_of('/');
+  if (last_slash == std::string_view::npos || last_slash == 0) {
+    return "/";
+  }
+  return std::string(path.substr(0, last_slash));
+}
+
+metadata_cache::children_prefetcher::mutation::mutation(children_prefetcher *prefetcher,
+                                                        const char *path, scope what)
+    : prefetcher_(prefetcher)
+{
+  if (prefetcher_ == nullptr) {
+    return;
+  }
+  if (what == scope::entries) {
+    dirs_.emplace_back(path);
+  } else {
+    dirs_.push_back(parent_of(path));
+    if (what == scope::directory && dirs_.back() != "/") {
+      dirs_.push_back(parent_of(dirs_.back()));
+    }
+  }
+  for (const std::string &dir : dirs_) {
+    slot &slot = prefetcher_->slot_of(dir);
+    std::unique_lock lock(slot.mtx_);
+    slot.in_progress_++;
+  }
+}
+
+metadata_cache::children_prefetcher::mutation::~mutation()
+{
+  if (prefetcher_ == nullptr) {
+    return;
+  }
+  for (const std::string &dir : dirs_) {
+    slot &slot = prefetcher_->slot_of(dir);
+    std::unique_lock lock(slot.mtx_);
+    slot.in_progress_--;
+    slot.completed_++;
+  }
+}
+
+metadata_cache::children_prefetcher::children_prefetcher(cache &cache)
+    : cache_(cache)
+    , busy_(false)
+    , stop_(false)
+{
+  for (slot &slot : slots_) {
+    slot.in_progress_ = 0;
+    slot.completed_ = 0;
+  }
+  thread_ = std::thread(&children_prefetcher::run, this);
+}
+
+metadata_cache::children_prefetcher::~children_prefetcher()
+{
+  std::unique_lock lock(mtx_);
+  stop_ = true;
+  queue_.clear();
+  lock.unlock();
+  cv_.notify_all();
+  thread_.join();
+}
+
+void
+metadata_cache::children_prefetcher::schedule(const std::string &dir,
+                                              std::vector<std::string> names)
+{
+  if (names.empty()) {
+    return;
+  }
+  std::unique_lock lock(mtx_);
+  if (queue_.size() >= max_pending) {
+    return;
+  }
+  queue_.push_back({dir, std::move(names)});
+  lock.unlock();
+  cv_.notify_one();
+}
+
+void
+metadata_cache::children_prefetcher::drain()
+{
+  std::unique_lock lock(mtx_);
+  idle_cv_.wait(lock, [this] {
+    return queue_.empty() && !busy_;
+  });
+}
+
+metadata_cache::children_prefetcher::slot &
+metadata_cache::children_prefetcher::slot_of(const std::string &dir)
+{
+  return slots_[absl::Hash<std::string>{}(dir) % n_slots];
+}
+
+void
+metadata_cache::children_prefetcher::run()
+{
+  std::unique_lock lock(mtx_);
+  while (true) {
+    cv_.wait(lock, [this] {
+      return stop_ || !queue_.empty();
+    });
+    if (stop_) {
+      return;
+    }
+    const job next = std::move(queue_.front());
+    queue_.pop_front();
+    busy_ = true;
+    lock.unlock();
+
+    prefetch(next);
+
+    lock.lock();
+    busy_ = false;
+    idle_cv_.notify_all();
+  }
+}
+
+void
+metadata_cache::children_prefetcher::prefetch(const job &job)
+{
+  const std::string prefix = job.dir_.ends_with('/') ? job.dir_ : job.dir_ + '/';
+  slot &slot = slot_of(job.dir_);
+
+  std::vector<std::string> paths;
+  utils::bulk_getattr::attributes found;
+  std::vector<std::string> missing;
+  for (size_t first = 0; first < job.names_.size(); first += batch) {
+    const size_t last = std::min(job.names_.size(), first + batch);
+    paths.clear();
+    for (size_t i = first; i < last; i++) {
+      paths.push_back(prefix + job.names_[i]);
+    }
+
+    std::unique_lock slot_lock(slot.mtx_);
+    const bool quiet = slot.in_progress_ == 0;
+    const uint64_t completed = slot.completed_;
+    slot_lock.unlock();
+    if (!quiet) {
+      continue;
+    }
+
+    found.clear();
+    missing.clear();
+    if (utils::bulk_getattr::instance().fetch(paths, found, missing) != 0) {
+      return;
+    }
+
+    // Mutations wait for the entries to be cached, so the ones they remove stay removed
+    slot_lock.lock();
+    if (slot.in_progress_ != 0 || slot.completed_ != completed) {
+      continue;
+    }
+    for (auto &[path, stbuf] : found) {
+      cache_.put(path, &stbuf);
+    }
+    for (const std::string &path : missing) {
+      cache_.put_negative(path);
+    }
+  }
+}
+
+} // namespace rsafefs
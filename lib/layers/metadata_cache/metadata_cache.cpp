@@ -1,34 +1,81 @@
 #include "rsafefs/layers/metadata_cache/metadata_cache.hpp"
 #include "rsafefs/layers/metadata_cache/cache.hpp"
-#include "rsafefs/layers/metadata_cache/drivers/lru.hpp"
-#include "rsafefs/layers/metadata_cache/drivers/rnd.hpp"
+#include "rsafefs/layers/metadata_cache/children_prefetcher.hpp"
+#include "rsafefs/utils/bulk_getattr.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
 #include "rsafefs/utils/utils.hpp"
+#include "rsafefs/utils/warm_start.hpp"
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
+#include <optional>
 
 namespace rsafefs
 {
 
 namespace fs = std::filesystem;
 
+using listing = metadata_cache::cache::listing;
+
 static fuse_operations next_layer;
 static metadata_cache::cache::config config;
 static metadata_cache::cache *cache = nullptr;
+static std::unique_ptr<utils::warm_start_prefetcher> warm_start;
+static std::unique_ptr<metadata_cache::children_prefetcher> prefetcher;
+
+using mutation = metadata_cache::children_prefetcher::mutation;
+using scope = metadata_cache::children_prefetcher::scope;
+
+// Fetches the attributes of a path listed by the manifest of the previous mount
+static void
+metadata_cache_warm_start(const utils::manifest_entry &entry,
+                          utils::warm_start_prefetcher &prefetcher)
+{
+  if (!prefetcher.pace()) {
+    return;
+  }
+  struct stat stbuf {
+  };
+  if (next_layer.getattr(entry.path_.c_str(), &stbuf) == 0 &&
+      utils::is_unchanged(entry, stbuf)) {
+    cache->put(entry.path_, &stbuf);
+  }
+}
 
 static void *
 metadata_cache_init(fuse_conn_info *conn)
 {
   cache = new metadata_cache::cache(config);
-  if (next_layer.init != nullptr) {
-    return next_layer.init(conn);
+  utils::memory_governor::instance().add("metadata_cache", cache);
+  // The prefetcher goes through the next layer, which must be ready first
+  void *private_data = next_layer.init != nullptr ? next_layer.init(conn) : nullptr;
+  if (!config.warm_start_manifest_.empty()) {
+    warm_start = std::make_unique<utils::warm_start_prefetcher>(
+        utils::load_manifest(config.warm_start_manifest_), config.warm_start_rate_,
+        metadata_cache_warm_start);
+    warm_start->start();
+  }
+  if (config.prefetch_children_ && utils::bulk_getattr::instance().available()) {
+    prefetcher = std::make_unique<metadata_cache::children_prefetcher>(*cache);
   }
-  return nullptr;
+  return private_data;
 }
 
 static void
 metadata_cache_destroy(void *private_data)
 {
   if (cache != nullptr) {
+    prefetcher.reset();
+    warm_start.reset();
+    if (!config.warm_start_manifest_.empty()) {
+      utils::save_manifest(config.warm_start_manifest_, cache->manifest());
+    }
+    const auto hit_stats = cache->hit_buffer_stats();
+    logging::debug("metadata cache hits: {} recorded for the eviction policy, "
+                   "{} dropped ({:.1f}%)",
+                   hit_stats.recorded_, hit_stats.dropped_, hit_stats.drop_rate() * 100);
+    utils::memory_governor::instance().remove(cache);
     delete cache;
     cache = nullptr;
   }
@@ -44,11 +91,17 @@ metadata_cache_getattr(const char *path, struct stat *stbuf)
   if (cache->get(path, stbuf)) {
     return 0;
   }
+  if (cache->get_negative(path)) {
+    return -ENOENT;
+  }
 
   const int res = next_layer.getattr(path, stbuf);
 
   if (res == 0) {
     cache->put(path, stbuf);
+    utils::memory_governor::instance().balance_if_due();
+  } else if (res == -ENOENT) {
+    cache->put_negative(path);
   }
 
   return res;
@@ -65,48 +118,231 @@ metadata_cache_fgetattr(const char *path, struct stat *stbuf, struct fuse_file_i
 
   if (res == 0) {
     cache->put(path, stbuf);
+    utils::memory_governor::instance().balance_if_due();
+  }
+
+  return res;
+}
+
+// Passes the entries of a listing from `first` on to the filler, until its buffer is full
+static void
+fill_from_listing(const listing &listing, size_t first, void *buf, fuse_fill_dir_t filler)
+{
+  for (size_t i = first; i < listing.entries_.size(); i++) {
+    const DirInfo::Entry &entry = listing.entries_[i];
+    if (filler(buf, entry.name_.c_str(), &entry.st_, entry.offset_)) {
+      break;
+    }
+  }
+}
+
+// Caches the attributes of an entry of `dir` listed by a readdir-plus. Entries without a
+// link count only carry their type, the layer below didn't fill them
+static void
+cache_listed_attributes(const std::string &dir, const char *name,
+                        const struct stat *stbuf)
+{
+  if (stbuf->st_nlink == 0 || std::strcmp(name, ".") == 0 ||
+      std::strcmp(name, "..") == 0) {
+    return;
+  }
+  std::string path = dir;
+  if (!path.ends_with('/')) {
+    path += '/';
   }
+  path += name;
+  struct stat entry_stbuf = *stbuf;
+  cache->put(path, &entry_stbuf);
+}
+
+// Collects the names of the listed entries whose attributes are left to the prefetcher,
+// the ones a readdir-plus didn't fill
+static void
+collect_child(std::vector<std::string> &names, const char *name, const struct stat *stbuf)
+{
+  if ((config.readdir_plus_ && stbuf->st_nlink != 0) || std::strcmp(name, ".") == 0 ||
+      std::strcmp(name, "..") == 0) {
+    return;
+  }
+  names.emplace_back(name);
+}
+
+// Filler of the readdir calls passed on to the next layer, caching the attributes too
+struct plus_filler_context {
+  void *buf_;
+  fuse_fill_dir_t filler_;
+  std::string dir_;
+  std::vector<std::string> children_;
+};
+
+static int
+plus_filler(void *buf, const char *name, const struct stat *stbuf, off_t off)
+{
+  auto *context = static_cast<plus_filler_context *>(buf);
+  if (config.readdir_plus_) {
+    cache_listed_attributes(context->dir_, name, stbuf);
+  }
+  if (prefetcher != nullptr) {
+    collect_child(context->children_, name, stbuf);
+  }
+  return context->filler_(context->buf_, name, stbuf, off);
+}
 
+// Passes a readdir on to the next layer, caching the attributes it lists if it fills them
+static int
+forward_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                struct fuse_file_info *fi)
+{
+  if (!config.readdir_plus_ && prefetcher == nullptr) {
+    return next_layer.readdir(path, buf, filler, offset, fi);
+  }
+  plus_filler_context context{
+      .buf_ = buf, .filler_ = filler, .dir_ = path, .children_ = {}};
+  const int res = next_layer.readdir(path, &context, plus_filler, offset, fi);
+  if (res == 0 && prefetcher != nullptr) {
+    prefetcher->schedule(path, std::move(context.children_));
+  }
+  utils::memory_governor::instance().balance_if_due();
+  return res;
+}
+
+static int
+metadata_cache_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                       struct fuse_file_info *fi)
+{
+  if (config.dir_size_ == 0) {
+    // Listings aren't cached, nothing to fetch beyond the readdir itself
+    return forward_readdir(path, buf, filler, offset, fi);
+  }
+
+  // Attributes of the directory in the next layer, taken before it is listed again
+  struct stat stbuf {
+  };
+  std::optional<int> getattr_res;
+
+  std::shared_ptr<const listing> cached = cache->get_listing(path);
+  if (cached != nullptr && offset == 0) {
+    // A new pass over the directory, which may have changed since it was listed. The
+    // cached attributes were taken with the listing, so they are fetched again
+    getattr_res = next_layer.getattr(path, &stbuf);
+    if (getattr_res != 0) {
+      cached = nullptr;
+    } else {
+      cache->put(path, &stbuf);
+      const struct timespec mtime = utils::mtime_of(stbuf);
+      if (mtime.tv_sec != cached->mtime_.tv_sec ||
+          mtime.tv_nsec != cached->mtime_.tv_nsec) {
+        cached = nullptr;
+      }
+    }
+  }
+  if (cached != nullptr) {
+    if (offset == 0) {
+      fill_from_listing(*cached, 0, buf, filler);
+      return 0;
+    }
+    const auto next_iterator = cached->next_.find(offset);
+    if (next_iterator != cached->next_.end()) {
+      fill_from_listing(*cached, next_iterator->second, buf, filler);
+      return 0;
+    }
+  }
+  if (offset != 0) {
+    return forward_readdir(path, buf, filler, offset, fi);
+  }
+
+  // The mtime is taken before the listing, so a change made meanwhile invalidates it
+  if (!getattr_res) {
+    getattr_res = next_layer.getattr(path, &stbuf);
+  }
+  DirInfo di;
+  const int res = next_layer.readdir(path, &di, rpc_filler, 0, fi);
+  if (res != 0) {
+    return res;
+  }
+
+  auto fetched = std::make_shared<listing>();
+  fetched->entries_ = std::move(di.buf_);
+  for (size_t i = 0; i < fetched->entries_.size(); i++) {
+    fetched->next_.emplace(fetched->entries_[i].offset_, i + 1);
+  }
+  fetched->mtime_ = utils::mtime_of(stbuf);
+  fill_from_listing(*fetched, 0, buf, filler);
+
+  if (config.readdir_plus_) {
+    // The getattr calls following a listing, as the ones of `ls -l`, hit
+    for (const DirInfo::Entry &entry : fetched->entries_) {
+      cache_listed_attributes(path, entry.name_.c_str(), &entry.st_);
+    }
+  }
+  if (prefetcher != nullptr) {
+    // Left to the prefetcher's thread, the listing is returned without waiting for it
+    std::vector<std::string> children;
+    for (const DirInfo::Entry &entry : fetched->entries_) {
+      collect_child(children, entry.name_.c_str(), &entry.st_);
+    }
+    prefetcher->schedule(path, std::move(children));
+  }
+  if (getattr_res == 0) {
+    cache->put(path, &stbuf);
+    cache->put_listing(path, std::move(fetched));
+  }
+  utils::memory_governor::instance().balance_if_due();
+  return 0;
+}
+
+// A getattr that missed the path before it was created may have cached it as missing
+// in the meantime, once it exists it is forgotten again
+static int
+created(const char *path, int res)
+{
+  if (res == 0) {
+    cache->remove_negative(path);
+  }
   return res;
 }
 
 static int
 metadata_cache_mknod(const char *path, mode_t mode, dev_t rdev)
 {
+  const mutation entry(prefetcher.get(), path, scope::directory);
   cache->remove(path);
   fs::path p = path;
   if (p.has_parent_path()) {
     cache->remove(p.parent_path());
   }
-  return next_layer.mknod(path, mode, rdev);
+  return created(path, next_layer.mknod(path, mode, rdev));
 }
 
 static int
 metadata_cache_mkdir(const char *path, mode_t mode)
 {
+  const mutation entry(prefetcher.get(), path, scope::directory);
   cache->remove(path);
   fs::path p = path;
   if (p.has_parent_path()) {
     cache->remove(p.parent_path());
   }
-  return next_layer.mkdir(path, mode);
+  return created(path, next_layer.mkdir(path, mode));
 }
 
 static int
 metadata_cache_symlink(const char *from, const char *to)
 {
+  const mutation entry(prefetcher.get(), to, scope::directory);
   cache->remove(from);
   cache->remove(to);
   fs::path t = to;
   if (t.has_parent_path()) {
     cache->remove(t.parent_path());
   }
-  return next_layer.symlink(from, to);
+  return created(to, next_layer.symlink(from, to));
 }
 
 static int
 metadata_cache_unlink(const char *path)
 {
+  const mutation entry(prefetcher.get(), path, scope::directory);
   cache->remove(path);
   fs::path p = path;
   if (p.has_parent_path()) {
@@ -118,6 +354,7 @@ metadata_cache_unlink(const char *path)
 static int
 metadata_cache_rmdir(const char *path)
 {
+  const mutation entry(prefetcher.get(), path, scope::directory);
   cache->remove(path);
   fs::path p = path;
   if (p.has_parent_path()) {
@@ -129,8 +366,16 @@ metadata_cache_rmdir(const char *path)
 static int
 metadata_cache_rename(const char *from, const char *to)
 {
+  // Both entries and their directories change, and so do the entries of a directory
+  // moved over
+  const mutation source(prefetcher.get(), from, scope::directory);
+  const mutation entry(prefetcher.get(), to, scope::directory);
+  const mutation source_entries(prefetcher.get(), from, scope::entries);
+  const mutation entries(prefetcher.get(), to, scope::entries);
   cache->remove(from);
   cache->remove(to);
+  // A directory moved to `to` brings its entries along
+  cache->remove_negatives_under(to);
   fs::path f = from;
   if (f.has_parent_path()) {
     cache->remove(f.parent_path());
@@ -139,24 +384,31 @@ metadata_cache_rename(const char *from, const char *to)
   if (t.has_parent_path()) {
     cache->remove(t.parent_path());
   }
-  return next_layer.rename(from, to);
+  const int res = next_layer.rename(from, to);
+  if (res == 0) {
+    cache->remove_negatives_under(to);
+  }
+  return created(to, res);
 }
 
 static int
 metadata_cache_link(const char *from, const char *to)
 {
+  const mutation source(prefetcher.get(), from);
+  const mutation entry(prefetcher.get(), to, scope::directory);
   cache->remove(from);
   cache->remove(to);
   fs::path t = to;
   if (t.has_parent_path()) {
     cache->remove(t.parent_path());
   }
-  return next_layer.link(from, to);
+  return created(to, next_layer.link(from, to));
 }
 
 static int
 metadata_cache_chmod(const char *path, mode_t mode)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.chmod(path, mode);
 }
@@ -164,6 +416,7 @@ metadata_cache_chmod(const char *path, mode_t mode)
 static int
 metadata_cache_chown(const char *path, uid_t uid, gid_t gid)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.chown(path, uid, gid);
 }
@@ -171,6 +424,7 @@ metadata_cache_chown(const char *path, uid_t uid, gid_t gid)
 static int
 metadata_cache_truncate(const char *path, off_t size)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.truncate(path, size);
 }
@@ -178,6 +432,7 @@ metadata_cache_truncate(const char *path, off_t size)
 static int
 metadata_cache_ftruncate(const char *path, off_t size, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.ftruncate(path, size, fi);
 }
@@ -185,6 +440,7 @@ metadata_cache_ftruncate(const char *path, off_t size, struct fuse_file_info *fi
 static int
 metadata_cache_utimens(const char *path, const struct timespec ts[2])
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.utimens(path, ts);
 }
@@ -192,17 +448,19 @@ metadata_cache_utimens(const char *path, const struct timespec ts[2])
 static int
 metadata_cache_create(const char *path, mode_t mode, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path, scope::directory);
   cache->remove(path);
   fs::path p = path;
   if (p.has_parent_path()) {
     cache->remove(p.parent_path());
   }
-  return next_layer.create(path, mode, fi);
+  return created(path, next_layer.create(path, mode, fi));
 }
 
 static int
 metadata_cache_open(const char *path, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.open(path, fi);
 }
@@ -210,6 +468,7 @@ metadata_cache_open(const char *path, struct fuse_file_info *fi)
 static int
 metadata_cache_flush(const char *path, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.flush(path, fi);
 }
@@ -217,6 +476,7 @@ metadata_cache_flush(const char *path, struct fuse_file_info *fi)
 static int
 metadata_cache_release(const char *path, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.release(path, fi);
 }
@@ -224,6 +484,7 @@ metadata_cache_release(const char *path, struct fuse_file_info *fi)
 static int
 metadata_cache_fsync(const char *path, int isdatasync, struct fuse_file_info *fi)
 {
+  const mutation entry(prefetcher.get(), path);
   cache->remove(path);
   return next_layer.fsync(path, isdatasync, fi);
 }
@@ -233,15 +494,33 @@ metadata_cache_config::metadata_cache_config(YAML::Node data)
   logging::debug("configuring metadata caching layer...");
 
   // Default configuration
+  using policy = metadata_cache::cache::eviction_policy;
   config.size_ = 100UL * 1024UL * 1024UL; // 100 MiB
+  config.shards_ = 16;                    // 16 independently locked shards
   config.time_out_ = 60;                  // 60 seconds
-  config.eviction_policy_ =
-      std::make_shared<metadata_cache::rnd_eviction>(); // random eviction
+  config.eviction_policy_ = policy::rnd;  // random eviction
+  config.tinylfu_admission_ = false;      // every missed entry is cached
+  config.warm_start_manifest_ = "";       // no warm start
+  config.warm_start_rate_ = 1024;         // 1024 paths a second
+  config.rules_ = {};                     // same policy for every path
+  config.negative_size_ = 0;              // missing paths aren't cached
+  config.negative_time_out_ = 5;          // 5 seconds
+  config.dir_size_ = 0;                   // directory listings aren't cached
+  config.readdir_plus_ = false;           // listed entries only carry their type
+  config.prefetch_children_ = false;      // children are fetched when looked up
 
   parser_.emplace("size", [&]() {
     config.size_ = data["size"].as<size_t>();
   });
 
+  parser_.emplace("shards", [&]() {
+    config.shards_ = data["shards"].as<size_t>();
+    if (config.shards_ == 0) {
+      throw metadata_cache_wrong_config_exception(
+          "number of shards must be greater than 0");
+    }
+  });
+
   parser_.emplace("time_out", [&]() {
     config.time_out_ = data["time_out"].as<int>();
   });
@@ -249,14 +528,65 @@ metadata_cache_config::metadata_cache_config(YAML::Node data)
   parser_.emplace("eviction_policy", [&]() {
     const std::string eviction_policy = data["eviction_policy"].as<std::string>();
     if (eviction_policy == "lru") {
-      config.eviction_policy_ = std::make_shared<metadata_cache::lru_eviction>();
+      config.eviction_policy_ = policy::lru;
     } else if (eviction_policy == "rnd") {
-      config.eviction_policy_ = std::make_shared<metadata_cache::rnd_eviction>();
+      config.eviction_policy_ = policy::rnd;
+    } else if (eviction_policy == "arc") {
+      config.eviction_policy_ = policy::arc;
+    } else if (eviction_policy == "sampled") {
+      config.eviction_policy_ = policy::sampled;
     } else {
       throw metadata_cache_wrong_config_exception("invalid replacement policy");
     }
   });
 
+  parser_.emplace("admission", [&]() {
+    const std::string admission = data["admission"].as<std::string>();
+    if (admission == "tinylfu") {
+      config.tinylfu_admission_ = true;
+    } else if (admission == "none") {
+      config.tinylfu_admission_ = false;
+    } else {
+      throw metadata_cache_wrong_config_exception("invalid admission policy");
+    }
+  });
+
+  parser_.emplace("warm_start_manifest", [&]() {
+    config.warm_start_manifest_ = data["warm_start_manifest"].as<std::string>();
+  });
+
+  parser_.emplace("warm_start_rate", [&]() {
+    config.warm_start_rate_ = data["warm_start_rate"].as<size_t>();
+    if (config.warm_start_rate_ == 0) {
+      throw metadata_cache_wrong_config_exception(
+          "warm start rate must be greater than 0");
+    }
+  });
+
+  parser_.emplace("negative_size", [&]() {
+    config.negative_size_ = data["negative_size"].as<size_t>();
+  });
+
+  parser_.emplace("negative_time_out", [&]() {
+    config.negative_time_out_ = data["negative_time_out"].as<int>();
+  });
+
+  parser_.emplace("dir_size", [&]() {
+    config.dir_size_ = data["dir_size"].as<size_t>();
+  });
+
+  parser_.emplace("readdir_plus", [&]() {
+    config.readdir_plus_ = data["readdir_plus"].as<bool>();
+  });
+
+  parser_.emplace("prefetch_children", [&]() {
+    config.prefetch_children_ = data["prefetch_children"].as<bool>();
+  });
+
+  parser_.emplace("rules", [&]() {
+    config.rules_ = utils::parse_path_rules(data["rules"]);
+  });
+
   for (const auto &kv : data) {
     const std::string &option = kv.first.as<std::string>();
     if (parser_.contains(option)) {
@@ -283,6 +613,7 @@ metadata_cache_config::init_layer(fuse_operations &operations)
   utils::stack_operation(metadata_cache_destroy, operations.destroy);
   utils::stack_operation(metadata_cache_getattr, operations.getattr);
   utils::stack_operation(metadata_cache_fgetattr, operations.fgetattr);
+  utils::stack_operation(metadata_cache_readdir, operations.readdir);
   utils::stack_operation(metadata_cache_mknod, operations.mknod);
   utils::stack_operation(metadata_cache_mkdir, operations.mkdir);
   utils::stack_operation(metadata_cache_symlink, operations.symlink);
@@ -1,6 +1,7 @@
 #include "rsafefs/layers/read_ahead/read_ahead.hpp"
 #include "rsafefs/layers/read_ahead/read_ahead_cache.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
 #include "rsafefs/utils/utils.hpp"
 
 namespace rsafefs
@@ -14,6 +15,7 @@ static void *
 read_ahead_init(fuse_conn_info *conn)
 {
   cache = new read_ahead::cache(config, next_layer);
+  utils::memory_governor::instance().add("read_ahead", cache);
 
   if (next_layer.init != nullptr) {
     return next_layer.init(conn);
@@ -26,6 +28,7 @@ static void
 read_ahead_destroy(void *private_data)
 {
   if (cache != nullptr) {
+    utils::memory_governor::instance().remove(cache);
     delete cache;
     cache = nullptr;
   }
@@ -45,7 +48,9 @@ static int
 read_ahead_read(const char *path, char *buf, size_t size, off_t offset,
                 struct fuse_file_info *fi)
 {
-  return cache->read(path, buf, size, offset, fi);
+  const int res = cache->read(path, buf, size, offset, fi);
+  utils::memory_governor::instance().balance_if_due();
+  return res;
 }
 
 static int
@@ -8,6 +8,8 @@ namespace rsafefs
 read_ahead::cache::cache(config &config, fuse_operations &operations)
     : config_(config)
     , operations_(operations)
+    , memory_(0)
+    , n_hits_(0)
 {
 }
 
@@ -36,7 +38,9 @@ read_ahead::cache::read(const char *path, char *buf, size_t size, off_t offset,
   buffer &buffer = buffers_.find(path)->second;
 
   n_of_bytes_read = buffer.read(buf, size, offset);
-  if (n_of_bytes_read < 0) {
+  if (n_of_bytes_read >= 0) {
+    n_hits_++;
+  } else {
     const size_t buf_size = std::max(size, config_.size_);
     auto new_buf = std::make_unique<char[]>(buf_size);
     const int res = operations_.read(path, new_buf.get(), buf_size, offset, fi);
@@ -46,7 +50,8 @@ read_ahead::cache::read(const char *path, char *buf, size_t size, off_t offset,
     n_of_bytes_read = std::min(static_cast<size_t>(res), size);
     std::memcpy(buf, new_buf.get(), n_of_bytes_read);
 
-    buffer.update(res, offset, std::move(new_buf));
+    memory_ += buf_size;
+    memory_ -= buffer.update(res, offset, std::move(new_buf), buf_size);
   }
 
   return n_of_bytes_read;
@@ -56,24 +61,72 @@ int
 read_ahead::cache::release(const char *path, struct fuse_file_info *fi)
 {
   std::unique_lock lock(mtx_);
-  buffers_.erase(path);
+  const auto buffer_iterator = buffers_.find(path);
+  if (buffer_iterator != buffers_.end()) {
+    memory_ -= buffer_iterator->second.capacity_;
+    buffers_.erase(buffer_iterator);
+  }
   lock.unlock();
   return operations_.release(path, fi);
 }
 
+size_t
+read_ahead::cache::memory_usage() const
+{
+  return memory_;
+}
+
+size_t
+read_ahead::cache::memory_hits() const
+{
+  return n_hits_;
+}
+
+size_t
+read_ahead::cache::shrink(size_t bytes)
+{
+  std::unique_lock lock(mtx_);
+  size_t released = 0;
+  for (auto &[path, buffer] : buffers_) {
+    if (released >= bytes) {
+      break;
+    }
+    released += buffer.clear();
+  }
+  memory_ -= released;
+  return released;
+}
+
 read_ahead::cache::buffer::buffer()
     : size_(0)
+    , capacity_(0)
     , offset_(-1)
 {
 }
 
-void
-read_ahead::cache::buffer::update(size_t size, off_t offset, std::unique_ptr<char[]> buf)
+size_t
+read_ahead::cache::buffer::update(size_t size, off_t offset, std::unique_ptr<char[]> buf,
+                                  size_t capacity)
 {
   std::unique_lock lock(mtx_);
+  const size_t old_capacity = capacity_;
   size_ = size;
+  capacity_ = capacity;
   offset_ = offset;
   buf_ = std::move(buf);
+  return old_capacity;
+}
+
+size_t
+read_ahead::cache::buffer::clear()
+{
+  std::unique_lock lock(mtx_);
+  const size_t old_capacity = capacity_;
+  size_ = 0;
+  capacity_ = 0;
+  offset_ = -1;
+  buf_.reset();
+  return old_capacity;
 }
 
 int
@@ -2,7 +2,9 @@
 #include "rsafefs/fuse_rpc/client.hpp"
 #include "rsafefs/fuse_rpc/grpc/async_client.hpp"
 #include "rsafefs/fuse_rpc/grpc/sync_client.hpp"
+#include "rsafefs/utils/bulk_getattr.hpp"
 #include "rsafefs/utils/logging.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
 #include "rsafefs/utils/utils.hpp"
 
 namespace rsafefs
@@ -11,17 +13,34 @@ namespace rsafefs
 static fuse_rpc::client::config *config = nullptr;
 static fuse_rpc::client *client = nullptr;
 
+static int
+rpc_client_getattr_compound(const std::vector<std::string> &paths,
+                            utils::bulk_getattr::attributes &found,
+                            std::vector<std::string> &missing)
+{
+  return client->getattr_compound(paths, found, missing);
+}
+
 static void *
 rpc_client_init(fuse_conn_info *conn)
 {
   if (utils::instance_of<fuse_rpc::grpc::async_client::config>(config)) {
     auto async_config = dynamic_cast<fuse_rpc::grpc::async_client::config *>(config);
-    client = new fuse_rpc::grpc::async_client(*async_config);
+    auto async_client = new fuse_rpc::grpc::async_client(*async_config);
+    // Written blocks wait in memory until they are flushed
+    utils::memory_governor::instance().add("rpc_client", async_client);
+    client = async_client;
   } else if (utils::instance_of<fuse_rpc::grpc::sync_client::config>(config)) {
     auto sync_config = dynamic_cast<fuse_rpc::grpc::sync_client::config *>(config);
     client = new fuse_rpc::grpc::sync_client(*sync_config);
   }
 
+  if (client != nullptr) {
+    // The attributes of many paths, as the children of a listed directory, are fetched
+    // in one round trip
+    utils::bulk_getattr::instance().provide(rpc_client_getattr_compound);
+  }
+
   return client;
 }
 
@@ -29,6 +48,10 @@ static void
 rpc_client_destroy([[maybe_unused]] void *private_data)
 {
   if (client != nullptr) {
+    utils::bulk_getattr::instance().withdraw();
+    if (auto async_client = dynamic_cast<fuse_rpc::grpc::async_client *>(client)) {
+      utils::memory_governor::instance().remove(async_client);
+    }
     delete client;
     client = nullptr;
   }
@@ -176,7 +199,9 @@ static int
 rpc_client_write(const char *path, const char *buf, size_t size, off_t offset,
                  struct fuse_file_info *fi)
 {
-  return client->write(path, buf, size, offset, fi);
+  const int res = client->write(path, buf, size, offset, fi);
+  utils::memory_governor::instance().balance_if_due();
+  return res;
 }
 
 static int
@@ -0,0 +1,47 @@
+#include "rsafefs/utils/bulk_getattr.hpp"
+#include <cerrno>
+#include <mutex>
+
+namespace rsafefs::utils
+{
+
+bulk_getattr &
+bulk_getattr::instance()
+{
+  static bulk_getattr bulk_getattr;
+  return bulk_getattr;
+}
+
+void
+bulk_getattr::provide(fetcher fetcher)
+{
+  std::unique_lock lock(mtx_);
+  fetcher_ = std::move(fetcher);
+}
+
+void
+bulk_getattr::withdraw()
+{
+  std::unique_lock lock(mtx_);
+  fetcher_ = nullptr;
+}
+
+bool
+bulk_getattr::available() const
+{
+  std::shared_lock lock(mtx_);
+  return fetcher_ != nullptr;
+}
+
+int
+bulk_getattr::fetch(const std::vector<std::string> &paths, attributes &found,
+                    std::vector<std::string> &missing) const
+{
+  std::shared_lock lock(mtx_);
+  if (fetcher_ == nullptr) {
+    return -ENOSYS;
+  }
+  return fetcher_(paths, found, missing);
+}
+
+} // namespace rsafefs::utils
@@ -0,0 +1,196 @@
+#include "rsafefs/utils/memory_governor.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <algorithm>
+
+namespace rsafefs::utils
+{
+
+memory_governor &
+memory_governor::instance()
+{
+  static memory_governor governor;
+  return governor;
+}
+
+memory_governor::memory_governor()
+    : budget_(0)
+    , pressure_limit_(0)
+    , next_balance_(0)
+{
+}
+
+void
+memory_governor::set_budget(size_t budget)
+{
+  budget_ = budget;
+}
+
+size_t
+memory_governor::budget() const
+{
+  return budget_;
+}
+
+void
+memory_governor::set_pressure_limit(size_t limit)
+{
+  pressure_limit_ = limit;
+}
+
+size_t
+memory_governor::pressure_limit() const
+{
+  return pressure_limit_;
+}
+
+size_t
+memory_governor::total_usage() const
+{
+  std::unique_lock lock(mtx_);
+  size_t total = 0;
+  for (const auto &entry : entries_) {
+    total += entry.consumer_->memory_usage();
+  }
+  return total;
+}
+
+void
+memory_governor::add(const std::string &name, memory_consumer *consumer)
+{
+  std::unique_lock lock(mtx_);
+  entries_.push_back({name, consumer, consumer->memory_hits(), 0});
+}
+
+void
+memory_governor::remove(memory_consumer *consumer)
+{
+  std::unique_lock lock(mtx_);
+  // Consumers leave at the unmount, with what they held and gave back over the mount
+  for (const usage &usage : breakdown_locked()) {
+    if (usage.consumer_ == consumer) {
+      log_usage(usage);
+    }
+  }
+  std::erase_if(entries_,
+                [&](const entry &entry) { return entry.consumer_ == consumer; });
+}
+
+void
+memory_governor::balance()
+{
+  const size_t pressure_limit = pressure_limit_;
+  size_t budget = budget_;
+  if (pressure_limit != 0 && (budget == 0 || pressure_limit < budget)) {
+    budget = pressure_limit;
+  }
+  if (budget == 0) {
+    return;
+  }
+
+  // A single thread balances, the others carry on
+  std::unique_lock lock(mtx_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+
+  struct candidate {
+    entry *entry_;
+    size_t bytes_;
+    double hits_per_byte_;
+  };
+  std::vector<candidate> candidates;
+  size_t total = 0;
+  for (auto &entry : entries_) {
+    const size_t bytes = entry.consumer_->memory_usage();
+    total += bytes;
+    if (bytes > 0) {
+      const size_t hits = entry.consumer_->memory_hits() - entry.balanced_hits_;
+      candidates.push_back({&entry, bytes, static_cast<double>(hits) / bytes});
+    }
+  }
+  if (total <= budget) {
+    return;
+  }
+
+  // Memory that served the fewest hits is given back first
+  std::sort(candidates.begin(), candidates.end(),
+            [](const candidate &a, const candidate &b) {
+              return a.hits_per_byte_ < b.hits_per_byte_ ||
+                     (a.hits_per_byte_ == b.hits_per_byte_ && a.bytes_ > b.bytes_);
+            });
+  const size_t excess = total - budget;
+  size_t released = 0;
+  for (auto &candidate : candidates) {
+    if (released >= excess) {
+      break;
+    }
+    const size_t shrunk = candidate.entry_->consumer_->shrink(excess - released);
+    candidate.entry_->shrunk_ += shrunk;
+    released += shrunk;
+    logging::debug("memory governor: {} gave back {} bytes ({:.3g} hits per byte)",
+                   candidate.entry_->name_, shrunk, candidate.hits_per_byte_);
+  }
+
+  // The next balance weighs the hits served from now on
+  for (auto &entry : entries_) {
+    entry.balanced_hits_ = entry.consumer_->memory_hits();
+  }
+
+  logging::info("memory governor: {} bytes released to fit in {} bytes", released,
+                budget);
+  for (const usage &usage : breakdown_locked()) {
+    log_usage(usage);
+  }
+}
+
+void
+memory_governor::balance_if_due()
+{
+  if (budget_.load(std::memory_order_relaxed) == 0 &&
+      pressure_limit_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+  int64_t next = next_balance_.load(std::memory_order_relaxed);
+  // The thread that moves the deadline balances, the others carry on
+  if (now < next ||
+      !next_balance_.compare_exchange_strong(
+          next, now + std::chrono::nanoseconds(balance_period).count(),
+          std::memory_order_relaxed)) {
+    return;
+  }
+  balance();
+}
+
+std::vector<memory_governor::usage>
+memory_governor::breakdown() const
+{
+  std::unique_lock lock(mtx_);
+  return breakdown_locked();
+}
+
+std::vector<memory_governor::usage>
+memory_governor::breakdown_locked() const
+{
+  std::vector<usage> usages;
+  usages.reserve(entries_.size());
+  for (const auto &entry : entries_) {
+    usages.push_back({.name_ = entry.name_,
+                      .consumer_ = entry.consumer_,
+                      .bytes_ = entry.consumer_->memory_usage(),
+                      .hits_ = entry.consumer_->memory_hits(),
+                      .shrunk_ = entry.shrunk_});
+  }
+  return usages;
+}
+
+void
+memory_governor::log_usage(const usage &usage)
+{
+  logging::info("memory governor: {} holds {} bytes, served {} hits, gave back {} bytes",
+                usage.name_, usage.bytes_, usage.hits_, usage.shrunk_);
+}
+
+} // namespace rsafefs::utils
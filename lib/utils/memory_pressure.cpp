@@ -0,0 +1,208 @@
+#include "rsafefs/utils/memory_pressure.hpp"
+#include "rsafefs/config.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+
+namespace rsafefs::utils
+{
+
+namespace fs = std::filesystem;
+
+memory_pressure_monitor::config
+memory_pressure_monitor::parse_config(const YAML::Node &data)
+{
+  // Default configuration
+  config config{
+      .cgroup_directory_ = "/sys/fs/cgroup",          // cgroup of the whole system
+      .interval_ = std::chrono::milliseconds(1000),   // 1 second
+      .usage_threshold_ = 0.9,                        // 90% of memory.max
+      .pressure_threshold_ = 10.0,                    // stalled 10% of the time
+      .shrink_ratio_ = 0.1,                           // 10% of the cached memory
+  };
+
+  const auto ratio = [&](const std::string &option, double &value) {
+    value = data[option].as<double>();
+    if (value <= 0.0 || value > 1.0) {
+      throw wrong_config_exception(
+          fmt::format("memory pressure: {} must be in ]0, 1]", option));
+    }
+  };
+
+  std::map<std::string, std::function<void()>> parser;
+
+  parser.emplace("cgroup_directory", [&]() {
+    config.cgroup_directory_ = data["cgroup_directory"].as<std::string>();
+  });
+
+  parser.emplace("interval", [&]() {
+    config.interval_ = std::chrono::milliseconds(data["interval"].as<size_t>());
+    if (config.interval_.count() == 0) {
+      throw wrong_config_exception("memory pressure: interval must be greater than 0");
+    }
+  });
+
+  parser.emplace("usage_threshold", [&]() {
+    ratio("usage_threshold", config.usage_threshold_);
+  });
+
+  parser.emplace("pressure_threshold", [&]() {
+    config.pressure_threshold_ = data["pressure_threshold"].as<double>();
+  });
+
+  parser.emplace("shrink_ratio", [&]() {
+    ratio("shrink_ratio", config.shrink_ratio_);
+  });
+
+  for (const auto &kv : data) {
+    const std::string &option = kv.first.as<std::string>();
+    if (parser.contains(option)) {
+      parser.at(option)();
+    } else {
+      logging::warn("Ignoring option: \"{}\", memory pressure doesn't recognises it",
+                    option);
+    }
+  }
+
+  return config;
+}
+
+memory_pressure_monitor::memory_pressure_monitor(const config &config,
+                                                 memory_governor &governor)
+    : config_(config)
+    , governor_(governor)
+    , stop_(false)
+{
+}
+
+memory_pressure_monitor::~memory_pressure_monitor()
+{
+  stop();
+}
+
+void
+memory_pressure_monitor::start()
+{
+  std::unique_lock lock(mtx_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stop_ = false;
+  thread_ = std::thread(&memory_pressure_monitor::run, this);
+}
+
+void
+memory_pressure_monitor::stop()
+{
+  std::unique_lock lock(mtx_);
+  if (!thread_.joinable()) {
+    return;
+  }
+  stop_ = true;
+  lock.unlock();
+  cv_.notify_all();
+  thread_.join();
+  // The caches may grow as they please once nobody watches the pressure
+  governor_.set_pressure_limit(0);
+}
+
+void
+memory_pressure_monitor::run()
+{
+  if (!check()) {
+    logging::warn("memory pressure: no cgroup v2 memory files in \"{}\"",
+                  config_.cgroup_directory_);
+  }
+
+  std::unique_lock lock(mtx_);
+  while (!cv_.wait_for(lock, config_.interval_, [this]() { return stop_; })) {
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+bool
+memory_pressure_monitor::check()
+{
+  const std::optional<sample> sample = read_sample();
+  if (!sample) {
+    return false;
+  }
+
+  const size_t cached = governor_.total_usage();
+  const size_t limit = governor_.pressure_limit();
+  if (is_under_pressure(sample.value())) {
+    // Below what is cached now, even if a previous limit was higher
+    const size_t target = cached - static_cast<size_t>(cached * config_.shrink_ratio_);
+    const size_t new_limit = limit == 0 ? target : std::min(limit, target);
+    governor_.set_pressure_limit(std::max<size_t>(new_limit, 1));
+    logging::debug("memory pressure: {} of {} bytes used, {:.1f}% stalled, caches "
+                   "limited to {} bytes",
+                   sample->current_, sample->max_.value_or(0), sample->pressure_,
+                   new_limit);
+    governor_.balance();
+  } else if (limit != 0) {
+    const size_t new_limit =
+        limit + std::max<size_t>(static_cast<size_t>(limit * config_.shrink_ratio_), 1);
+    const size_t budget = governor_.budget();
+    // Lifted once it no longer holds the caches back
+    if ((budget != 0 && new_limit >= budget) || cached < new_limit / 2) {
+      governor_.set_pressure_limit(0);
+      logging::debug("memory pressure: gone, caches may grow back");
+    } else {
+      governor_.set_pressure_limit(new_limit);
+    }
+  }
+  return true;
+}
+
+std::optional<memory_pressure_monitor::sample>
+memory_pressure_monitor::read_sample() const
+{
+  const fs::path directory = config_.cgroup_directory_;
+  sample sample{.current_ = 0, .max_ = {}, .pressure_ = 0.0};
+
+  std::ifstream current(directory / "memory.current");
+  if (!(current >> sample.current_)) {
+    return {};
+  }
+
+  std::ifstream max(directory / "memory.max");
+  std::string max_value;
+  if (!(max >> max_value)) {
+    return {};
+  }
+  if (max_value != "max") {
+    sample.max_ = std::stoull(max_value);
+  }
+
+  // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0", kernels without PSI lack the file
+  std::ifstream pressure(directory / "memory.pressure");
+  std::string line;
+  while (std::getline(pressure, line)) {
+    const size_t avg10 = line.find("avg10=");
+    if (line.starts_with("some") && avg10 != std::string::npos) {
+      sample.pressure_ = std::stod(line.substr(avg10 + 6));
+      break;
+    }
+  }
+
+  return sample;
+}
+
+bool
+memory_pressure_monitor::is_under_pressure(const sample &sample) const
+{
+  if (sample.pressure_ >= config_.pressure_threshold_) {
+    return true;
+  }
+  return sample.max_ && sample.max_.value() > 0 &&
+         static_cast<double>(sample.current_) / sample.max_.value() >=
+             config_.usage_threshold_;
+}
+
+} // namespace rsafefs::utils
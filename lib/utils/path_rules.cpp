@@ -0,0 +1,173 @@
+#include "rsafefs/utils/path_rules.hpp"
+#include "rsafefs/config.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <algorithm>
+#include <fnmatch.h>
+#include <functional>
+#include <map>
+
+namespace rsafefs::utils
+{
+
+static bool
+has_wildcards(std::string_view pattern)
+{
+  return pattern.find_first_of("*?[") != std::string_view::npos;
+}
+
+// Calls f on every component of a path until it returns false
+template <typename F>
+static void
+for_each_component(std::string_view path, F &&f)
+{
+  size_t begin = path.find_first_not_of('/');
+  while (begin != std::string_view::npos) {
+    const size_t end = std::min(path.find('/', begin), path.size());
+    if (!f(path.substr(begin, end - begin))) {
+      return;
+    }
+    begin = path.find_first_not_of('/', end);
+  }
+}
+
+std::vector<path_rule>
+parse_path_rules(const YAML::Node &data)
+{
+  if (!data.IsSequence()) {
+    throw wrong_config_exception("path rules: rules must be a list");
+  }
+
+  std::vector<path_rule> rules;
+  for (const auto &item : data) {
+    // Default configuration
+    path_rule rule{
+        .pattern_ = "",
+        .time_out_ = {},  // the time out of the cache
+        .pin_ = false,    // evicted as any other entry
+        .bypass_ = false, // cached
+        .priority_ = 0,
+    };
+
+    std::map<std::string, std::function<void()>> parser;
+
+    parser.emplace("path", [&]() {
+      rule.pattern_ = item["path"].as<std::string>();
+    });
+
+    parser.emplace("time_out", [&]() {
+      rule.time_out_ = item["time_out"].as<int>();
+      if (rule.time_out_.value() < 0) {
+        throw wrong_config_exception("path rules: time_out can't be negative");
+      }
+    });
+
+    parser.emplace("pin", [&]() {
+      rule.pin_ = item["pin"].as<bool>();
+    });
+
+    parser.emplace("bypass", [&]() {
+      rule.bypass_ = item["bypass"].as<bool>();
+    });
+
+    parser.emplace("priority", [&]() {
+      rule.priority_ = item["priority"].as<int>();
+    });
+
+    for (const auto &kv : item) {
+      const std::string &option = kv.first.as<std::string>();
+      if (parser.contains(option)) {
+        parser.at(option)();
+      } else {
+        logging::warn("Ignoring option: \"{}\", path rules don't recognise it", option);
+      }
+    }
+
+    if (!rule.pattern_.starts_with('/')) {
+      throw wrong_config_exception("path rules: path must be absolute");
+    }
+    if (rule.pin_ && rule.bypass_) {
+      throw wrong_config_exception(
+          fmt::format("path rules: {} can't be pinned and bypassed", rule.pattern_));
+    }
+    rules.push_back(std::move(rule));
+  }
+  return rules;
+}
+
+path_rules::path_rules(std::vector<path_rule> rules)
+    : rules_(std::move(rules))
+    , nodes_(1)
+{
+  for (size_t i = 0; i < rules_.size(); i++) {
+    const std::string &pattern = rules_[i].pattern_;
+    size_t current = 0;
+    for_each_component(pattern, [&](std::string_view component) {
+      if (has_wildcards(component)) {
+        return false;
+      }
+      const auto [child_iterator, inserted] =
+          nodes_[current].children_.try_emplace(component, nodes_.size());
+      current = child_iterator->second;
+      if (inserted) {
+        nodes_.emplace_back();
+      }
+      return true;
+    });
+    node &node = nodes_[current];
+    (has_wildcards(pattern) ? node.globs_ : node.prefixes_).push_back(i);
+  }
+
+  const auto by_priority = [this](size_t a, size_t b) {
+    return rules_[a].priority_ > rules_[b].priority_;
+  };
+  for (auto &node : nodes_) {
+    std::stable_sort(node.prefixes_.begin(), node.prefixes_.end(), by_priority);
+    std::stable_sort(node.globs_.begin(), node.globs_.end(), by_priority);
+  }
+}
+
+const path_rule *
+path_rules::lookup(std::string_view path) const
+{
+  const path_rule *best = nullptr;
+  // fnmatch wants a terminated string, only built for the paths reaching a glob
+  std::optional<std::string> subject;
+
+  // Deeper nodes win ties, they match a longer prefix
+  const auto consider = [&](const node &node) {
+    if (!node.prefixes_.empty()) {
+      const path_rule &rule = rules_[node.prefixes_.front()];
+      if (best == nullptr || rule.priority_ >= best->priority_) {
+        best = &rule;
+      }
+    }
+    for (const size_t i : node.globs_) {
+      const path_rule &rule = rules_[i];
+      if (best != nullptr && rule.priority_ < best->priority_) {
+        break;
+      }
+      if (!subject) {
+        subject.emplace(path);
+      }
+      if (fnmatch(rule.pattern_.c_str(), subject->c_str(), 0) == 0) {
+        best = &rule;
+        break;
+      }
+    }
+  };
+
+  const node *current = &nodes_.front();
+  consider(*current);
+  for_each_component(path, [&](std::string_view component) {
+    const auto child_iterator = current->children_.find(component);
+    if (child_iterator == current->children_.end()) {
+      return false;
+    }
+    current = &nodes_[child_iterator->second];
+    consider(*current);
+    return true;
+  });
+  return best;
+}
+
+} // namespace rsafefs::utils
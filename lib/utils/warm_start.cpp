@@ -0,0 +1,217 @@
+#include "rsafefs/utils/warm_start.hpp"
+#include "rsafefs/utils/logging.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace rsafefs::utils
+{
+
+static constexpr uint64_t manifest_magic = 0x31666e616d736672; // "rfsmanf1"
+static constexpr uint64_t manifest_format = 1;
+// Longer paths than any file system allows mean the manifest is corrupted
+static constexpr uint64_t max_path_length = 4096;
+
+namespace
+{
+
+struct manifest_header {
+  uint64_t magic_;
+  uint64_t format_;
+  uint64_t n_entries_;
+};
+
+// Followed by the path and the block ids
+struct manifest_record {
+  int64_t mtime_sec_;
+  int64_t mtime_nsec_;
+  int64_t size_;
+  uint64_t path_length_;
+  uint64_t n_blocks_;
+};
+
+} // namespace
+
+struct timespec
+mtime_of(const struct stat &stbuf)
+{
+#ifdef __APPLE__
+  return stbuf.st_mtimespec;
+#else
+  return stbuf.st_mtim;
+#endif
+}
+
+bool
+is_unchanged(const manifest_entry &entry, const struct stat &stbuf)
+{
+  const struct timespec mtime = mtime_of(stbuf);
+  return mtime.tv_sec == entry.mtime_.tv_sec && mtime.tv_nsec == entry.mtime_.tv_nsec &&
+         stbuf.st_size == entry.size_;
+}
+
+bool
+save_manifest(const std::string &manifest_path,
+              const std::vector<manifest_entry> &entries)
+{
+  const std::string tmp_path = manifest_path + ".tmp";
+  std::ofstream manifest(tmp_path, std::ios::binary | std::ios::trunc);
+
+  const manifest_header header{
+      .magic_ = manifest_magic,
+      .format_ = manifest_format,
+      .n_entries_ = entries.size(),
+  };
+  manifest.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto &entry : entries) {
+    const manifest_record record{
+        .mtime_sec_ = entry.mtime_.tv_sec,
+        .mtime_nsec_ = entry.mtime_.tv_nsec,
+        .size_ = entry.size_,
+        .path_length_ = entry.path_.size(),
+        .n_blocks_ = entry.blocks_.size(),
+    };
+    manifest.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    manifest.write(entry.path_.data(), entry.path_.size());
+    manifest.write(reinterpret_cast<const char *>(entry.blocks_.data()),
+                   entry.blocks_.size() * sizeof(uint64_t));
+  }
+  manifest.close();
+
+  if (!manifest || std::rename(tmp_path.c_str(), manifest_path.c_str()) != 0) {
+    logging::warn("warm start: unable to save the manifest at {}", manifest_path);
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::vector<manifest_entry>
+load_manifest(const std::string &manifest_path)
+{
+  std::ifstream manifest(manifest_path, std::ios::binary);
+  std::vector<manifest_entry> entries;
+
+  manifest_header header{};
+  if (!manifest.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic_ != manifest_magic || header.format_ != manifest_format) {
+    if (manifest.is_open()) {
+      logging::warn("warm start: ignoring the manifest at {}, it isn't valid",
+                    manifest_path);
+    }
+    return entries;
+  }
+
+  manifest_record record{};
+  for (uint64_t i = 0; i < header.n_entries_ &&
+                       manifest.read(reinterpret_cast<char *>(&record), sizeof(record));
+       i++) {
+    if (record.path_length_ > max_path_length) {
+      break;
+    }
+    manifest_entry entry{};
+    entry.mtime_.tv_sec = record.mtime_sec_;
+    entry.mtime_.tv_nsec = record.mtime_nsec_;
+    entry.size_ = record.size_;
+    entry.path_.resize(record.path_length_);
+    if (!manifest.read(entry.path_.data(), record.path_length_)) {
+      break;
+    }
+    // One by one, a corrupted count mustn't allocate more than the file holds
+    uint64_t block_id;
+    for (uint64_t j = 0;
+         j < record.n_blocks_ &&
+         manifest.read(reinterpret_cast<char *>(&block_id), sizeof(block_id));
+         j++) {
+      entry.blocks_.push_back(block_id);
+    }
+    if (entry.blocks_.size() != record.n_blocks_) {
+      break;
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+warm_start_prefetcher::warm_start_prefetcher(std::vector<manifest_entry> entries,
+                                             size_t rate, replay_fn replay)
+    : entries_(std::move(entries))
+    , period_(std::chrono::nanoseconds(std::chrono::seconds(1)) /
+              std::max<size_t>(rate, 1))
+    , replay_(std::move(replay))
+    , stop_(false)
+    , n_paced_(0)
+{
+}
+
+warm_start_prefetcher::~warm_start_prefetcher()
+{
+  stop();
+}
+
+void
+warm_start_prefetcher::start()
+{
+  std::unique_lock lock(mtx_);
+  if (thread_.joinable()) {
+    return;
+  }
+  next_ = std::chrono::steady_clock::now();
+  thread_ = std::thread(&warm_start_prefetcher::run, this);
+}
+
+void
+warm_start_prefetcher::stop()
+{
+  std::unique_lock lock(mtx_);
+  stop_ = true;
+  lock.unlock();
+  cv_.notify_all();
+  join();
+}
+
+void
+warm_start_prefetcher::join()
+{
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool
+warm_start_prefetcher::pace()
+{
+  std::unique_lock lock(mtx_);
+  // A replay that fell behind, e.g. on slow fetches, doesn't catch up in a burst
+  next_ = std::max(next_, std::chrono::steady_clock::now() - period_) + period_;
+  if (cv_.wait_until(lock, next_, [this]() { return stop_; })) {
+    return false;
+  }
+  n_paced_++;
+  return true;
+}
+
+size_t
+warm_start_prefetcher::paced() const
+{
+  std::unique_lock lock(mtx_);
+  return n_paced_;
+}
+
+void
+warm_start_prefetcher::run()
+{
+  for (const auto &entry : entries_) {
+    {
+      std::unique_lock lock(mtx_);
+      if (stop_) {
+        break;
+      }
+    }
+    replay_(entry, *this);
+  }
+  logging::debug("warm start: {} fetches replayed from a manifest of {} entries",
+                 paced(), entries_.size());
+}
+
+} // namespace rsafefs::utils
@@ -0,0 +1,55 @@
+#include "rsafefs/utils/bulk_getattr.hpp"
+#include <cerrno>
+#include <gtest/gtest.h>
+
+using namespace rsafefs;
+
+TEST(BulkGetattrTest, UnavailableWithoutProvider)
+{
+  utils::bulk_getattr &bulk_getattr = utils::bulk_getattr::instance();
+  bulk_getattr.withdraw();
+
+  utils::bulk_getattr::attributes found;
+  std::vector<std::string> missing;
+  EXPECT_FALSE(bulk_getattr.available());
+  EXPECT_EQ(bulk_getattr.fetch({"/a"}, found, missing), -ENOSYS);
+  EXPECT_TRUE(found.empty());
+}
+
+TEST(BulkGetattrTest, FetchesThroughProvider)
+{
+  utils::bulk_getattr &bulk_getattr = utils::bulk_getattr::instance();
+  size_t calls = 0;
+  bulk_getattr.provide([&](const std::vector<std::string> &paths,
+                           utils::bulk_getattr::attributes &found,
+                           std::vector<std::string> &missing) {
+    calls++;
+    // Only the paths under /dir exist
+    for (const std::string &path : paths) {
+      if (path.starts_with("/dir/")) {
+        struct stat stbuf {
+        };
+        stbuf.st_size = static_cast<off_t>(path.size());
+        found.emplace_back(path, stbuf);
+      } else {
+        missing.push_back(path);
+      }
+    }
+    return 0;
+  });
+
+  utils::bulk_getattr::attributes found;
+  std::vector<std::string> missing;
+  ASSERT_TRUE(bulk_getattr.available());
+  ASSERT_EQ(bulk_getattr.fetch({"/dir/a", "/missing", "/dir/bc"}, found, missing), 0);
+  EXPECT_EQ(calls, 1);
+  ASSERT_EQ(found.size(), 2);
+  EXPECT_EQ(found[0].first, "/dir/a");
+  EXPECT_EQ(found[0].second.st_size, 6);
+  EXPECT_EQ(found[1].first, "/dir/bc");
+  EXPECT_EQ(found[1].second.st_size, 7);
+  EXPECT_EQ(missing, std::vector<std::string>{"/missing"});
+
+  bulk_getattr.withdraw();
+  EXPECT_FALSE(bulk_getattr.available());
+}
@@ -0,0 +1,155 @@
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/cache.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "rsafefs/common/cache/tinylfu_manager.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rsafefs;
+
+namespace
+{
+
+using key = std::string;
+
+struct value {
+  int data_;
+  size_t size_;
+  bool valid_;
+};
+
+struct value_size {
+  size_t operator()(const value &value) const { return value.size_; }
+};
+
+struct is_valid {
+  bool operator()(const value &value) const { return value.valid_; }
+};
+
+template <typename Policy> struct policy_traits {
+  template <typename Cache> static std::unique_ptr<Cache> make(size_t capacity)
+  {
+    return std::make_unique<Cache>(capacity, value_size{}, is_valid{});
+  }
+};
+
+// The admission filter wraps another manager
+template <> struct policy_traits<common::managed_policy<tinylfu_cache_manager<key>>> {
+  template <typename Cache> static std::unique_ptr<Cache> make(size_t capacity)
+  {
+    return std::make_unique<Cache>(capacity, value_size{}, is_valid{},
+                                   std::make_unique<lru_cache_manager<key>>());
+  }
+};
+
+} // namespace
+
+// Every instantiation of the generic cache must pass the same suite
+template <typename Policy> class CacheTest : public ::testing::Test
+{
+protected:
+  using cache = common::cache<key, value, Policy, value_size, is_valid>;
+
+  std::unique_ptr<cache> make_cache(size_t capacity)
+  {
+    return policy_traits<Policy>::template make<cache>(capacity);
+  }
+};
+
+using policies = ::testing::Types<common::intrusive_lru_policy<key, value>,
+                                  common::managed_policy<lru_cache_manager<key>>,
+                                  common::managed_policy<rnd_cache_manager<key>>,
+                                  common::managed_policy<arc_cache_manager<key>>,
+                                  common::managed_policy<sampled_cache_manager<key>>,
+                                  common::managed_policy<tinylfu_cache_manager<key>>>;
+TYPED_TEST_SUITE(CacheTest, policies);
+
+TYPED_TEST(CacheTest, PutThenGet)
+{
+  auto cache = this->make_cache(10);
+  value value{};
+  EXPECT_FALSE(cache->get("/a", value));
+
+  cache->put("/a", {.data_ = 1, .size_ = 1, .valid_ = true});
+  ASSERT_TRUE(cache->get("/a", value));
+  EXPECT_EQ(value.data_, 1);
+
+  cache->put("/a", {.data_ = 2, .size_ = 3, .valid_ = true});
+  ASSERT_TRUE(cache->get("/a", value));
+  EXPECT_EQ(value.data_, 2);
+  EXPECT_EQ(cache->size(), 3);
+}
+
+TYPED_TEST(CacheTest, RemoveDropsTheValue)
+{
+  auto cache = this->make_cache(10);
+  cache->put("/a", {.data_ = 1, .size_ = 2, .valid_ = true});
+  cache->remove("/a");
+
+  value value{};
+  EXPECT_FALSE(cache->get("/a", value));
+  EXPECT_EQ(cache->size(), 0);
+}
+
+TYPED_TEST(CacheTest, InvalidValuesAreDropped)
+{
+  auto cache = this->make_cache(10);
+  cache->put("/a", {.data_ = 1, .size_ = 2, .valid_ = false});
+
+  value value{};
+  EXPECT_FALSE(cache->get("/a", value));
+  EXPECT_EQ(cache->size(), 0);
+}
+
+TYPED_TEST(CacheTest, SizeNeverExceedsCapacity)
+{
+  auto cache = this->make_cache(10);
+  value value{};
+  for (int i = 0; i < 100; i++) {
+    const size_t size = 1 + i % 3;
+    cache->put("/" + std::to_string(i), {.data_ = i, .size_ = size, .valid_ = true});
+    cache->get("/" + std::to_string(i / 2), value);
+    EXPECT_LE(cache->size(), 10);
+  }
+}
+
+TYPED_TEST(CacheTest, ConcurrentHitsAndPuts)
+{
+  auto cache = this->make_cache(64);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      value value{};
+      for (int i = 0; i < 2000; i++) {
+        const std::string key = "/" + std::to_string((i * 7 + t) % 128);
+        if (!cache->get(key, value)) {
+          cache->put(key, {.data_ = i, .size_ = 1, .valid_ = true});
+        }
+        if (i % 50 == 0) {
+          cache->remove(key);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache->size(), 64);
+}
+
+TYPED_TEST(CacheTest, ShrinkEvictsUntilEnoughIsFreed)
+{
+  auto cache = this->make_cache(10);
+  for (int i = 0; i < 5; i++) {
+    cache->put("/" + std::to_string(i), {.data_ = i, .size_ = 2, .valid_ = true});
+  }
+
+  EXPECT_EQ(cache->shrink(3), 4);
+  EXPECT_EQ(cache->size(), 6);
+  EXPECT_EQ(cache->shrink(100), 6);
+  EXPECT_EQ(cache->size(), 0);
+}
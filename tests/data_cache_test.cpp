@@ -1,8 +1,129 @@
+#include "rsafefs/common/cache/arc_manager.hpp"
+#include "rsafefs/common/cache/lru_manager.hpp"
+#include "rsafefs/common/cache/read_buffer.hpp"
+#include "rsafefs/common/cache/rnd_manager.hpp"
+#include "rsafefs/common/cache/sampled_manager.hpp"
+#include "rsafefs/common/cache/tinylfu_manager.hpp"
+#include "rsafefs/layers/data_cache/cache.hpp"
 #include "rsafefs/layers/data_cache/data_cache.hpp"
+#include "rsafefs/utils/memory_governor.hpp"
+#include <absl/container/flat_hash_set.h>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace rsafefs;
 
+class DataCacheReadTest : public ::testing::Test
+{
+protected:
+  static constexpr size_t block_size = 4096; // a page, so the pools trim every free block
+  static constexpr size_t file_size = 10 * block_size + 100;
+
+  static inline std::atomic<int> backend_reads = 0;
+  static inline std::atomic<int> backend_getattrs = 0;
+  static inline std::atomic<time_t> backend_mtime = 0;
+  static inline std::atomic<bool> hold_backend_reads = false;
+  static inline std::atomic<int> backend_writes = 0;
+  static inline std::atomic<bool> hold_backend_writes = false;
+
+  DataCacheReadTest()
+  {
+    memset(&operations_, 0, sizeof(operations_));
+
+    operations_.getattr = [](const char *, struct stat *stbuf) {
+      backend_getattrs++;
+      memset(stbuf, 0, sizeof(struct stat));
+      stbuf->st_ino = 1;
+      stbuf->st_size = file_size;
+      stbuf->st_mtime = backend_mtime;
+      return 0;
+    };
+
+    operations_.open = [](const char *, fuse_file_info *) {
+      return 0;
+    };
+
+    operations_.release = [](const char *, fuse_file_info *) {
+      return 0;
+    };
+
+    operations_.read = [](const char *, char *buf, size_t size, off_t offset,
+                          fuse_file_info *) {
+      backend_reads++;
+      while (hold_backend_reads) {
+        std::this_thread::yield();
+      }
+      if (static_cast<size_t>(offset) >= file_size) {
+        return 0;
+      }
+      const size_t n_bytes = std::min(size, file_size - offset);
+      for (size_t i = 0; i < n_bytes; i++) {
+        buf[i] = static_cast<char>((offset + i) % 251);
+      }
+      return static_cast<int>(n_bytes);
+    };
+
+    operations_.write = [](const char *, const char *, size_t size, off_t,
+                           fuse_file_info *) {
+      backend_writes++;
+      while (hold_backend_writes) {
+        std::this_thread::yield();
+      }
+      return static_cast<int>(size);
+    };
+
+    operations_.truncate = [](const char *, off_t) {
+      return 0;
+    };
+
+    operations_.ftruncate = [](const char *, off_t, fuse_file_info *) {
+      return 0;
+    };
+
+    config_.size_ = 4 * file_size;
+    config_.block_size_ = block_size;
+    config_.shards_ = 4;
+    config_.max_fetch_blocks_ = 64;
+    config_.hugepages_ = false;
+    config_.time_out_ = 0;
+    config_.attr_time_out_ = 0;
+    config_.disk_directory_ = "";
+    config_.disk_size_ = 0;
+    config_.stale_while_revalidate_ = false;
+    config_.refresh_workers_ = 1;
+    config_.high_watermark_ = 1.0;
+    config_.low_watermark_ = 1.0;
+    config_.warm_start_manifest_ = "";
+    config_.warm_start_rate_ = 1;
+    config_.rules_ = {};
+    config_.eviction_policy_ = data_cache::cache::eviction_policy::lru;
+    config_.tinylfu_admission_ = false;
+  }
+
+  void SetUp() override
+  {
+    backend_reads = 0;
+    backend_getattrs = 0;
+    backend_mtime = 0;
+    hold_backend_reads = false;
+    backend_writes = 0;
+    hold_backend_writes = false;
+  }
+
+  static void expect_content(const char *buf, size_t size, off_t offset)
+  {
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_EQ(buf[i], static_cast<char>((offset + i) % 251)) << "at byte " << i;
+    }
+  }
+
+  fuse_operations operations_;
+  data_cache::cache::config config_;
+  fuse_file_info fi_{};
+};
+
 TEST(DataCacheTest, EmptyConfig)
 {
   YAML::Node config = YAML::Load("");
@@ -11,11 +132,29 @@ TEST(DataCacheTest, EmptyConfig)
 
 TEST(DataCacheTest, ValidConfig)
 {
-  YAML::Node config = YAML::Load(
-      "{size: 1073741824, block_size: 1024, time_out: 20, eviction_policy: rnd}");
+  YAML::Node config = YAML::Load("{size: 1073741824, block_size: 1024, shards: 8, "
+                                 "hugepages: false, time_out: 20, eviction_policy: rnd, "
+                                 "stale_while_revalidate: true, refresh_workers: 2}");
   ASSERT_NO_THROW(std::make_unique<data_cache_config>(config));
 }
 
+TEST(DataCacheTest, Watermarks)
+{
+  YAML::Node config = YAML::Load("{high_watermark: 0.9, low_watermark: 0.7}");
+  ASSERT_NO_THROW(std::make_unique<data_cache_config>(config));
+}
+
+TEST(DataCacheTest, WrongWatermarks)
+{
+  for (const char *watermarks :
+       {"{high_watermark: 0.7, low_watermark: 0.9}", "{high_watermark: 1.5}",
+        "{low_watermark: 0}"}) {
+    YAML::Node config = YAML::Load(watermarks);
+    EXPECT_THROW(std::make_unique<data_cache_config>(config),
+                 data_cache_wrong_config_exception);
+  }
+}
+
 TEST(DataCacheTest, WrongEvictionPolicy)
 {
   YAML::Node config = YAML::Load("{eviction_policy: lfu}");
@@ -23,12 +162,204 @@ TEST(DataCacheTest, WrongEvictionPolicy)
                data_cache_wrong_config_exception);
 }
 
+TEST(DataCacheTest, ArcEvictionPolicy)
+{
+  YAML::Node config = YAML::Load("{eviction_policy: arc}");
+  ASSERT_NO_THROW(std::make_unique<data_cache_config>(config));
+}
+
+TEST(DataCacheTest, ArcKeepsFrequentBlocksAcrossScans)
+{
+  arc_cache_manager<size_t> manager;
+  // Fill a cache of 4 blocks, 0 and 1 are used again
+  for (size_t key = 0; key < 4; key++) {
+    manager.touch(key);
+  }
+  manager.touch(0);
+  manager.touch(1);
+
+  // A scan only replaces the blocks used once
+  for (size_t key = 100; key < 110; key++) {
+    const auto victim = manager.evict();
+    ASSERT_TRUE(victim);
+    EXPECT_NE(victim.value(), 0);
+    EXPECT_NE(victim.value(), 1);
+    manager.touch(key);
+  }
+}
+
+TEST(DataCacheTest, SampledEvictionPolicy)
+{
+  YAML::Node config = YAML::Load("{eviction_policy: sampled}");
+  ASSERT_NO_THROW(std::make_unique<data_cache_config>(config));
+}
+
+TEST(DataCacheTest, ConstantTimeManagersEvictEveryKeyOnce)
+{
+  rnd_cache_manager<size_t> rnd;
+  sampled_cache_manager<size_t> sampled;
+  const std::vector<cache_manager<size_t> *> managers = {&rnd, &sampled};
+  for (cache_manager<size_t> *manager : managers) {
+    for (size_t key = 0; key < 100; key++) {
+      manager->touch(key);
+    }
+    // Removed keys are swapped with the last ones
+    for (size_t key = 0; key < 100; key += 3) {
+      manager->remove(key);
+    }
+
+    absl::flat_hash_set<size_t> evicted;
+    while (const auto key = manager->evict()) {
+      EXPECT_NE(key.value() % 3, 0);
+      EXPECT_TRUE(evicted.insert(key.value()).second);
+    }
+    EXPECT_EQ(evicted.size(), 66);
+  }
+}
+
+TEST(DataCacheTest, SampledEvictsLeastRecentlyUsed)
+{
+  // Sampling every key, or more, makes it an exact LRU
+  sampled_cache_manager<size_t> manager(64);
+  manager.touch(0);
+  manager.touch(1);
+  manager.touch(0);
+  EXPECT_EQ(manager.evict(), 1);
+  EXPECT_EQ(manager.evict(), 0);
+  EXPECT_FALSE(manager.evict());
+}
+
+TEST(DataCacheTest, TinyLfuAdmission)
+{
+  YAML::Node config = YAML::Load("{admission: tinylfu, eviction_policy: lru}");
+  ASSERT_NO_THROW(std::make_unique<data_cache_config>(config));
+}
+
+TEST(DataCacheTest, WrongAdmission)
+{
+  YAML::Node config = YAML::Load("{admission: lfu}");
+  ASSERT_THROW(std::make_unique<data_cache_config>(config),
+               data_cache_wrong_config_exception);
+}
+
+TEST(DataCacheTest, TinyLfuRejectsBlocksUsedOnce)
+{
+  tinylfu_cache_manager<size_t> manager(std::make_unique<lru_cache_manager<size_t>>());
+  // Fill a cache of 4 blocks and use them until their counters saturate, so a block
+  // of the scan can't beat them even if it shares all its counters with them
+  for (int i = 0; i < 20; i++) {
+    for (size_t key = 0; key < 4; key++) {
+      manager.touch(key);
+    }
+  }
+
+  // The first block of the scan makes the block in the window move on
+  ASSERT_TRUE(manager.evict());
+  manager.touch(100);
+
+  // Every other block of the scan loses against the cached ones
+  for (size_t key = 101; key < 110; key++) {
+    const auto victim = manager.evict();
+    ASSERT_TRUE(victim);
+    EXPECT_GE(victim.value(), 100);
+    manager.touch(key);
+  }
+}
+
+TEST(DataCacheTest, ReadBufferDropsHitsWhenFull)
+{
+  read_buffer<int> buffer;
+  std::vector<int> entries(100);
+  for (int &entry : entries) {
+    buffer.record(&entry);
+  }
+  // A single thread fills a single ring
+  const auto stats = buffer.get_stats();
+  EXPECT_GT(stats.recorded_, 0);
+  EXPECT_GT(stats.dropped_, 0);
+  EXPECT_EQ(stats.recorded_ + stats.dropped_, entries.size());
+
+  std::vector<int *> replayed;
+  buffer.drain([&](int *entry) { replayed.push_back(entry); });
+  ASSERT_EQ(replayed.size(), stats.recorded_);
+  for (size_t i = 0; i < replayed.size(); i++) {
+    EXPECT_EQ(replayed[i], &entries[i]);
+  }
+
+  // Drained rings take hits again
+  buffer.record(&entries[0]);
+  EXPECT_EQ(buffer.get_stats().recorded_, stats.recorded_ + 1);
+}
+
+TEST(DataCacheTest, ZeroShards)
+{
+  YAML::Node config = YAML::Load("{shards: 0}");
+  ASSERT_THROW(std::make_unique<data_cache_config>(config),
+               data_cache_wrong_config_exception);
+}
+
 TEST(DataCacheTest, WrongDataTypes)
 {
   YAML::Node config = YAML::Load("{size: string}");
   ASSERT_ANY_THROW(std::make_unique<data_cache_config>(config));
 }
 
+TEST(DataCacheTest, BlockPoolRecyclesBlocks)
+{
+  data_cache::block_pool pool(2, 1024, false);
+
+  auto first = pool.allocate();
+  auto second = pool.allocate();
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  EXPECT_NE(first.get(), second.get());
+  EXPECT_FALSE(pool.allocate());
+
+  auto stats = pool.get_stats();
+  EXPECT_EQ(stats.used_, 2);
+  EXPECT_EQ(stats.free_list_length_, 0);
+  EXPECT_EQ(stats.failed_allocations_, 1);
+  EXPECT_DOUBLE_EQ(stats.utilization(), 1.0);
+
+  char *recycled = first.get();
+  first.reset();
+  EXPECT_EQ(pool.allocate().get(), recycled);
+
+  stats = pool.get_stats();
+  EXPECT_EQ(stats.used_, 1);
+  EXPECT_EQ(stats.free_list_length_, 1);
+  EXPECT_EQ(stats.peak_used_, 2);
+}
+
+TEST(DataCacheTest, BlockPoolTrimsFreeBuffers)
+{
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  data_cache::block_pool pool(4, page_size, false);
+  EXPECT_EQ(pool.resident_bytes(), 0);
+
+  auto first = pool.allocate();
+  auto second = pool.allocate();
+  std::memset(first.get(), 'x', page_size);
+  std::memset(second.get(), 'x', page_size);
+  EXPECT_EQ(pool.resident_bytes(), 2 * page_size);
+
+  // Free buffers stay resident until they are trimmed
+  first.reset();
+  EXPECT_EQ(pool.resident_bytes(), 2 * page_size);
+  EXPECT_EQ(pool.trim(), page_size);
+  EXPECT_EQ(pool.resident_bytes(), page_size);
+  EXPECT_EQ(pool.get_stats().cold_, 3);
+
+  // Its pages were given back, the next use of the buffer faults in zeroed ones
+  second.reset();
+  EXPECT_EQ(pool.trim(), page_size);
+  auto reused = pool.allocate();
+  ASSERT_TRUE(reused);
+  for (size_t i = 0; i < page_size; i++) {
+    ASSERT_EQ(reused[i], 0) << "at byte " << i;
+  }
+}
+
 TEST(DataCacheTest, InitLayerValid)
 {
   YAML::Node config = YAML::Load("");
@@ -57,6 +388,19 @@ TEST(DataCacheTest, InitLayerValid)
     return 0;
   };
 
+  bottom_operations.write = [](const char *, const char *, size_t, off_t,
+                               fuse_file_info *) {
+    return 0;
+  };
+
+  bottom_operations.truncate = [](const char *, off_t) {
+    return 0;
+  };
+
+  bottom_operations.ftruncate = [](const char *, off_t, fuse_file_info *) {
+    return 0;
+  };
+
   ASSERT_NO_THROW(data_cache_layer->init_layer(bottom_operations));
 }
 
@@ -70,4 +414,513 @@ TEST(DataCacheTest, InitLayerInvalid)
 
   ASSERT_THROW(data_cache_layer->init_layer(bottom_operations),
                utils::stack_operation_exception);
-}
\ No newline at end of file
+}
+
+TEST(DataCacheTest, DiskTierSurvivesRestarts)
+{
+  char directory[] = "/tmp/data_cache_test_XXXXXX";
+  ASSERT_NE(mkdtemp(directory), nullptr);
+
+  data_cache::file_identity identity{};
+  identity.ino_ = 42;
+  identity.size_ = 1524;
+  const std::string first(1024, 'a');
+  const std::string second(500, 'b');
+  std::vector<char> buf(1024);
+
+  {
+    data_cache::disk_tier tier(directory, 4 * 1024, 1024);
+    tier.put(identity, 0, first.data(), first.size());
+    tier.put(identity, 1, second.data(), second.size());
+    EXPECT_TRUE(tier.contains(identity, 1));
+    EXPECT_EQ(tier.get(identity, 0, buf.data()), first.size());
+    EXPECT_EQ(std::string(buf.data(), first.size()), first);
+
+    tier.remove(identity.ino_, 0, 1);
+    EXPECT_FALSE(tier.get(identity, 0, buf.data()));
+    EXPECT_EQ(tier.get_stats().used_, 1);
+  }
+
+  {
+    data_cache::disk_tier tier(directory, 4 * 1024, 1024);
+    EXPECT_EQ(tier.get(identity, 1, buf.data()), second.size());
+    EXPECT_EQ(std::string(buf.data(), second.size()), second);
+
+    // Blocks of another version of the file are dropped
+    data_cache::file_identity modified = identity;
+    modified.mtime_.tv_sec = 1;
+    EXPECT_FALSE(tier.get(modified, 1, buf.data()));
+    EXPECT_EQ(tier.get_stats().used_, 0);
+  }
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(DataCacheReadTest, ShardedCacheServesHits)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  expect_content(buf.data(), file_size, 0);
+  const int misses = backend_reads;
+  EXPECT_EQ(misses, 1);
+
+  std::fill(buf.begin(), buf.end(), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  expect_content(buf.data(), file_size, 0);
+  EXPECT_EQ(backend_reads, misses);
+  EXPECT_EQ(cache.size(), 11 * block_size);
+
+  ASSERT_EQ(cache.read("/file", buf.data(), 2000, 1500, &fi_), 2000);
+  expect_content(buf.data(), 2000, 1500);
+  EXPECT_EQ(backend_reads, misses);
+}
+
+TEST_F(DataCacheReadTest, MissingRunsAreFetchedTogether)
+{
+  config_.max_fetch_blocks_ = 4;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), 10, 5 * block_size, &fi_), 10);
+  EXPECT_EQ(backend_reads, 1);
+
+  // Runs [0, 4), [4, 5) and [6, 10), [10, 11) around the cached block 5
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  expect_content(buf.data(), file_size, 0);
+  EXPECT_EQ(backend_reads, 5);
+  EXPECT_EQ(cache.size(), 11 * block_size);
+}
+
+TEST_F(DataCacheReadTest, ShardsEvictIndependently)
+{
+  config_.size_ = 4 * block_size;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  expect_content(buf.data(), file_size, 0);
+
+  // Each shard may only overshoot its own capacity by a single block
+  EXPECT_LE(cache.size(), config_.size_ + config_.shards_ * block_size);
+  EXPECT_EQ(cache.allocator_stats().used_ * block_size, cache.size());
+}
+
+TEST_F(DataCacheReadTest, ReclaimerEvictsDownToTheLowWatermark)
+{
+  config_.size_ = 10 * block_size;
+  config_.shards_ = 1;
+  config_.high_watermark_ = 0.8;
+  config_.low_watermark_ = 0.5;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(9 * block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), 9 * block_size, 0, &fi_), 9 * block_size);
+  expect_content(buf.data(), 9 * block_size, 0);
+
+  // The misses stayed below the capacity, the blocks past 80% go in the background
+  for (int i = 0; i < 200 && cache.size() > 5 * block_size; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(cache.size(), 5 * block_size);
+  EXPECT_EQ(cache.reclaimed_blocks(), 4);
+}
+
+TEST_F(DataCacheReadTest, IntrusiveLruEvictsLeastRecentlyUsed)
+{
+  config_.size_ = 4 * block_size;
+  config_.shards_ = 1;
+  config_.eviction_policy_ = data_cache::cache::eviction_policy::lru;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  for (size_t block_id = 0; block_id < 5; block_id++) {
+    ASSERT_EQ(cache.read("/file", buf.data(), block_size, block_id * block_size, &fi_),
+              block_size);
+  }
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+
+  // The shard is over its capacity, block 1 is the least recently used one
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 5 * block_size, &fi_),
+            block_size);
+  EXPECT_EQ(backend_reads, 6);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  expect_content(buf.data(), block_size, 0);
+  EXPECT_EQ(backend_reads, 6);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, block_size, &fi_), block_size);
+  expect_content(buf.data(), block_size, block_size);
+  EXPECT_EQ(backend_reads, 7);
+}
+
+TEST_F(DataCacheReadTest, ShrinkEvictsBlocksFromEveryShard)
+{
+  config_.size_ = 8 * block_size;
+  config_.shards_ = 2;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(8 * block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), 8 * block_size, 0, &fi_), 8 * block_size);
+  const size_t cached = cache.memory_usage();
+  ASSERT_GT(cached, 2 * block_size);
+
+  EXPECT_EQ(cache.shrink(2 * block_size), 2 * block_size);
+  EXPECT_EQ(cache.memory_usage(), cached - 2 * block_size);
+  EXPECT_EQ(cache.shrink(cached), cached - 2 * block_size);
+  EXPECT_EQ(cache.memory_usage(), 0);
+}
+
+TEST_F(DataCacheReadTest, PressureShrinksResidentMemory)
+{
+  config_.size_ = 8 * block_size;
+  config_.shards_ = 2;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(8 * block_size);
+  utils::memory_governor &governor = utils::memory_governor::instance();
+  governor.add("data_cache", &cache);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), 8 * block_size, 0, &fi_), 8 * block_size);
+  const size_t cached = cache.memory_usage();
+  ASSERT_EQ(cached, 8 * block_size);
+
+  // The memory pressure monitor lowers the limit, the pages of the evicted blocks are
+  // given back rather than kept in the free lists
+  governor.set_pressure_limit(cached / 2);
+  governor.balance();
+  EXPECT_LE(cache.memory_usage(), cached / 2);
+  EXPECT_EQ(cache.allocator_stats().cold_ * block_size,
+            cache.allocator_stats().capacity_ * block_size - cache.memory_usage());
+
+  governor.set_pressure_limit(0);
+  governor.remove(&cache);
+}
+
+TEST_F(DataCacheReadTest, PathRulesPinAndBypassFiles)
+{
+  config_.size_ = 4 * block_size;
+  config_.shards_ = 1;
+  config_.rules_ = utils::parse_path_rules(YAML::Load(R"(
+    - {path: /models, pin: true}
+    - {path: /checkpoints, bypass: true}
+  )"));
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(4 * block_size);
+
+  fuse_file_info pinned_fi{};
+  ASSERT_EQ(cache.open("/models/weights", &pinned_fi), 0);
+  ASSERT_EQ(cache.read("/models/weights", buf.data(), 2 * block_size, 0, &pinned_fi),
+            2 * block_size);
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), 4 * block_size, 0, &fi_), 4 * block_size);
+  const int misses = backend_reads;
+
+  // The pool overshoots the capacity by one block, so three blocks of /file are left
+  // next to the pinned ones. Shrinking evicts all of them, the pinned ones stay
+  ASSERT_EQ(cache.size(), 5 * block_size);
+  EXPECT_EQ(cache.shrink(config_.size_), 3 * block_size);
+  ASSERT_EQ(cache.read("/models/weights", buf.data(), 2 * block_size, 0, &pinned_fi),
+            2 * block_size);
+  expect_content(buf.data(), 2 * block_size, 0);
+  EXPECT_EQ(backend_reads, misses);
+  EXPECT_EQ(cache.size(), 2 * block_size);
+
+  fuse_file_info bypassed_fi{};
+  ASSERT_EQ(cache.open("/checkpoints/step_1", &bypassed_fi), 0);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(cache.read("/checkpoints/step_1", buf.data(), block_size, 0, &bypassed_fi),
+              block_size);
+  }
+  EXPECT_EQ(backend_reads, misses + 2);
+  EXPECT_EQ(cache.size(), 2 * block_size);
+}
+
+TEST_F(DataCacheReadTest, ManifestListsTheNewestBlocksFirst)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 3 * block_size, &fi_),
+            block_size);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 7 * block_size, &fi_),
+            block_size);
+
+  const std::vector<utils::manifest_entry> manifest = cache.manifest();
+  ASSERT_EQ(manifest.size(), 1);
+  EXPECT_EQ(manifest[0].path_, "/file");
+  EXPECT_EQ(manifest[0].size_, file_size);
+  EXPECT_EQ(manifest[0].blocks_, std::vector<uint64_t>({7, 3}));
+}
+
+TEST_F(DataCacheReadTest, EvictedBlocksArePromotedFromDisk)
+{
+  char directory[] = "/tmp/data_cache_test_XXXXXX";
+  ASSERT_NE(mkdtemp(directory), nullptr);
+  config_.size_ = 4 * block_size;
+  config_.shards_ = 1;
+  config_.disk_directory_ = directory;
+  config_.disk_size_ = 16 * block_size;
+
+  {
+    data_cache::cache cache(config_, operations_);
+    std::vector<char> buf(file_size);
+
+    ASSERT_EQ(cache.open("/file", &fi_), 0);
+    ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+    const int misses = backend_reads;
+    EXPECT_GT(cache.disk_stats()->demotions_, 0);
+
+    std::fill(buf.begin(), buf.end(), 0);
+    ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+    expect_content(buf.data(), file_size, 0);
+    EXPECT_EQ(backend_reads, misses);
+    EXPECT_GT(cache.disk_stats()->hits_, 0);
+    ASSERT_EQ(cache.release("/file", &fi_), 0);
+  }
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(DataCacheReadTest, BlocksOutliveTheirHandles)
+{
+  config_.attr_time_out_ = 60;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  EXPECT_EQ(cache.size(), 11 * block_size);
+
+  // Reopened within the validation period: no attributes, no reads
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(cache.open("/file", &fi_), 0);
+    ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+    expect_content(buf.data(), file_size, 0);
+    ASSERT_EQ(cache.release("/file", &fi_), 0);
+  }
+  EXPECT_EQ(backend_getattrs, 1);
+  EXPECT_EQ(backend_reads, 1);
+}
+
+TEST_F(DataCacheReadTest, ChangedFileDropsItsBlocks)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  EXPECT_EQ(backend_reads, 1);
+
+  // Modified by someone else
+  backend_mtime = 1;
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  EXPECT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  EXPECT_EQ(backend_reads, 2);
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+}
+
+TEST_F(DataCacheReadTest, WritesUpdateCachedBlocks)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+
+  // Spans blocks 1 and 2, then extends the file past its last block
+  const std::string data(block_size, 'x');
+  ASSERT_EQ(cache.write("/file", data.data(), data.size(), 1500, &fi_), data.size());
+  ASSERT_EQ(cache.write("/file", data.data(), 10, file_size + 50, &fi_), 10);
+
+  std::fill(buf.begin(), buf.end(), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 1500, &fi_), block_size);
+  EXPECT_EQ(std::string(buf.data(), block_size), data);
+  ASSERT_EQ(cache.read("/file", buf.data(), 100, file_size, &fi_), 60);
+  EXPECT_EQ(std::string(buf.data(), 50), std::string(50, '\0'));
+  EXPECT_EQ(std::string(buf.data() + 50, 10), std::string(10, 'x'));
+  EXPECT_EQ(backend_reads, 1);
+}
+
+TEST_F(DataCacheReadTest, LocalWritesDontHideOtherChanges)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+  const std::string data(10, 'x');
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+
+  // The mtime changed by our own write is the one reported after it, the blocks stay
+  backend_mtime = 1;
+  ASSERT_EQ(cache.write("/file", data.data(), data.size(), 0, &fi_), data.size());
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  EXPECT_EQ(cache.size(), 11 * block_size);
+
+  // Written again and then by someone else before the next open
+  backend_mtime = 2;
+  ASSERT_EQ(cache.write("/file", data.data(), data.size(), 0, &fi_), data.size());
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  backend_mtime = 3;
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  EXPECT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+  EXPECT_EQ(backend_reads, 2);
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+}
+
+TEST_F(DataCacheReadTest, TruncateShrinksCachedBlocks)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+
+  ASSERT_EQ(cache.ftruncate("/file", 2 * block_size + 10, &fi_), 0);
+  EXPECT_EQ(cache.size(), 3 * block_size);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), 2 * block_size + 10);
+  expect_content(buf.data(), 2 * block_size + 10, 0);
+
+  // Growing again reads back zeros, without going to the next layer
+  ASSERT_EQ(cache.truncate("/file", 3 * block_size), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 2 * block_size, &fi_),
+            block_size);
+  expect_content(buf.data(), 10, 2 * block_size);
+  EXPECT_EQ(std::string(buf.data() + 10, block_size - 10),
+            std::string(block_size - 10, '\0'));
+  EXPECT_EQ(backend_reads, 1);
+}
+
+TEST_F(DataCacheReadTest, OverlappingWritesDropTheirBlocks)
+{
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(file_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), file_size, 0, &fi_), file_size);
+
+  // Both writes are in the next layer at once, the order they land in is unknown
+  hold_backend_writes = true;
+  const std::string data(10, 'x');
+  std::vector<std::thread> writers;
+  for (const size_t block_id : {0, 2}) {
+    writers.emplace_back([&, block_id]() {
+      EXPECT_EQ(cache.write("/file", data.data(), data.size(), block_id * block_size,
+                            &fi_),
+                data.size());
+    });
+  }
+  while (backend_writes != 2) {
+    std::this_thread::yield();
+  }
+  hold_backend_writes = false;
+  for (auto &writer : writers) {
+    writer.join();
+  }
+
+  // Their blocks are read again, the other ones are still cached
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, block_size, &fi_), block_size);
+  EXPECT_EQ(backend_reads, 1);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 2 * block_size, &fi_),
+            block_size);
+  EXPECT_EQ(backend_reads, 2);
+}
+
+TEST_F(DataCacheReadTest, ExpiredBlocksAreRefreshedInBackground)
+{
+  config_.time_out_ = 1;
+  config_.stale_while_revalidate_ = true;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+  // The next layer is stuck, the expired block is still served
+  hold_backend_reads = true;
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  expect_content(buf.data(), block_size, 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  EXPECT_EQ(cache.fetch_stats().stale_serves_, 2);
+
+  hold_backend_reads = false;
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  EXPECT_EQ(cache.fetch_stats().refreshes_, 1);
+  EXPECT_EQ(backend_reads, 2);
+}
+
+TEST_F(DataCacheReadTest, RefreshesDontBlockWrites)
+{
+  config_.time_out_ = 1;
+  config_.stale_while_revalidate_ = true;
+  data_cache::cache cache(config_, operations_);
+  std::vector<char> buf(block_size);
+
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+  // The refresh is stuck in the next layer while the block is written
+  hold_backend_reads = true;
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  while (backend_reads != 2) {
+    std::this_thread::yield();
+  }
+  const std::string data(10, 'x');
+  ASSERT_EQ(cache.write("/file", data.data(), data.size(), 0, &fi_), data.size());
+
+  // The refreshed copy may predate the write, it is thrown away
+  hold_backend_reads = false;
+  ASSERT_EQ(cache.release("/file", &fi_), 0);
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+  ASSERT_EQ(cache.read("/file", buf.data(), block_size, 0, &fi_), block_size);
+  EXPECT_EQ(std::string(buf.data(), data.size()), data);
+  expect_content(buf.data() + data.size(), block_size - data.size(), data.size());
+}
+
+TEST_F(DataCacheReadTest, ConcurrentMissesAreCoalesced)
+{
+  constexpr size_t n_readers = 8;
+  data_cache::cache cache(config_, operations_);
+  ASSERT_EQ(cache.open("/file", &fi_), 0);
+
+  hold_backend_reads = true;
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < n_readers; i++) {
+    readers.emplace_back([&]() {
+      std::vector<char> buf(block_size);
+      EXPECT_EQ(cache.read("/file", buf.data(), block_size, block_size, &fi_),
+                block_size);
+      expect_content(buf.data(), block_size, block_size);
+    });
+  }
+
+  // Release the backend once every other reader is waiting on the first fetch
+  while (cache.fetch_stats().coalesced_ != n_readers - 1) {
+    std::this_thread::yield();
+  }
+  hold_backend_reads = false;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(backend_reads, 1);
+  EXPECT_EQ(cache.fetch_stats().fetches_, 1);
+}
@@ -1,4 +1,9 @@
+#include "rsafefs/fuse_rpc/utils/dir_info.hpp"
 #include "rsafefs/layers/local/local.hpp"
+#include "rsafefs/layers/local/local_operations.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 
 using namespace rsafefs;
@@ -25,4 +30,38 @@ TEST(LocalTest, WrongMode)
 {
   YAML::Node config = YAML::Load("{path: /tmp, mode: invalid_mode}");
   ASSERT_THROW(std::make_unique<local_config>(config), local_wrong_config_exception);
-}
\ No newline at end of file
+}
+
+TEST(LocalTest, ReaddirPlusConfig)
+{
+  YAML::Node config = YAML::Load("{path: /tmp, readdir_plus: true}");
+  ASSERT_NO_THROW(std::make_unique<local_config>(config));
+}
+
+TEST(LocalTest, ReaddirPlusFillsAttributes)
+{
+  char dir_template[] = "/tmp/rsafefs_local_test_XXXXXX";
+  const std::string dir = mkdtemp(dir_template);
+  std::ofstream(dir + "/file") << "hello";
+
+  for (const bool readdir_plus : {false, true}) {
+    fuse_operations operations;
+    memset(&operations, 0, sizeof(operations));
+    assign_local_operations(operations, dir, readdir_plus);
+
+    fuse_file_info fi{};
+    ASSERT_EQ(operations.opendir("/", &fi), 0);
+    DirInfo di;
+    ASSERT_EQ(operations.readdir("/", &di, rpc_filler, 0, &fi), 0);
+    operations.releasedir("/", &fi);
+
+    const auto is_file = [](const DirInfo::Entry &entry) { return entry.name_ == "file"; };
+    const auto entry = std::find_if(di.buf_.begin(), di.buf_.end(), is_file);
+    ASSERT_NE(entry, di.buf_.end());
+    EXPECT_TRUE(S_ISREG(entry->st_.st_mode));
+    EXPECT_EQ(entry->st_.st_size, readdir_plus ? 5 : 0);
+    EXPECT_EQ(entry->st_.st_nlink, readdir_plus ? 1 : 0);
+  }
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,143 @@
+#include "rsafefs/utils/memory_governor.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace rsafefs;
+
+namespace
+{
+
+class fake_consumer : public utils::memory_consumer
+{
+public:
+  fake_consumer(size_t bytes)
+      : bytes_(bytes)
+      , hits_(0)
+  {
+  }
+
+  [[nodiscard]] size_t memory_usage() const override { return bytes_; }
+
+  [[nodiscard]] size_t memory_hits() const override { return hits_; }
+
+  size_t shrink(size_t bytes) override
+  {
+    const size_t released = std::min(bytes, bytes_);
+    bytes_ -= released;
+    return released;
+  }
+
+  size_t bytes_;
+  size_t hits_;
+};
+
+// The governor is process wide, every test leaves it as it found it
+class MemoryGovernorTest : public ::testing::Test
+{
+protected:
+  void TearDown() override
+  {
+    for (auto *consumer : {&cold_, &hot_}) {
+      governor_.remove(consumer);
+    }
+    governor_.set_budget(0);
+  }
+
+  utils::memory_governor &governor_ = utils::memory_governor::instance();
+  fake_consumer cold_{600};
+  fake_consumer hot_{600};
+};
+
+} // namespace
+
+TEST_F(MemoryGovernorTest, NoBudget)
+{
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  governor_.balance();
+  EXPECT_EQ(cold_.bytes_, 600);
+  EXPECT_EQ(hot_.bytes_, 600);
+}
+
+TEST_F(MemoryGovernorTest, WithinBudget)
+{
+  governor_.set_budget(1200);
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  governor_.balance();
+  EXPECT_EQ(cold_.bytes_ + hot_.bytes_, 1200);
+}
+
+TEST_F(MemoryGovernorTest, ShrinksFewestHitsPerByteFirst)
+{
+  governor_.set_budget(1000);
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  cold_.hits_ = 10;
+  hot_.hits_ = 1000;
+  governor_.balance();
+  EXPECT_EQ(cold_.bytes_, 400);
+  EXPECT_EQ(hot_.bytes_, 600);
+
+  // Once the cold consumer is empty the hot one gives memory back too
+  hot_.hits_ = 2000;
+  governor_.set_budget(200);
+  governor_.balance();
+  EXPECT_EQ(cold_.bytes_, 0);
+  EXPECT_EQ(hot_.bytes_, 200);
+}
+
+TEST_F(MemoryGovernorTest, HitsAreWeighedSinceTheLastBalance)
+{
+  governor_.set_budget(1100);
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  cold_.hits_ = 1000;
+  governor_.balance();
+  EXPECT_EQ(hot_.bytes_, 500);
+
+  // The hits that made the first consumer valuable are old news now
+  hot_.hits_ = 10;
+  governor_.set_budget(1000);
+  governor_.balance();
+  EXPECT_EQ(cold_.bytes_, 500);
+  EXPECT_EQ(hot_.bytes_, 500);
+}
+
+TEST_F(MemoryGovernorTest, Breakdown)
+{
+  governor_.set_budget(1000);
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  hot_.hits_ = 5;
+  governor_.balance();
+
+  const auto usages = governor_.breakdown();
+  ASSERT_EQ(usages.size(), 2);
+  EXPECT_EQ(usages[0].name_, "cold");
+  EXPECT_EQ(usages[0].consumer_, &cold_);
+  EXPECT_EQ(usages[0].bytes_, 400);
+  EXPECT_EQ(usages[0].shrunk_, 200);
+  EXPECT_EQ(usages[1].name_, "hot");
+  EXPECT_EQ(usages[1].bytes_, 600);
+  EXPECT_EQ(usages[1].hits_, 5);
+  EXPECT_EQ(usages[1].shrunk_, 0);
+}
+
+TEST_F(MemoryGovernorTest, BalanceIfDueIsRateLimited)
+{
+  governor_.set_budget(1000);
+  governor_.add("cold", &cold_);
+  governor_.add("hot", &hot_);
+  std::this_thread::sleep_for(utils::memory_governor::balance_period);
+  governor_.balance_if_due();
+  EXPECT_EQ(cold_.bytes_ + hot_.bytes_, 1000);
+
+  // Grown past the budget again right away, it waits for the next period
+  cold_.bytes_ += 100;
+  governor_.balance_if_due();
+  EXPECT_EQ(cold_.bytes_ + hot_.bytes_, 1100);
+  std::this_thread::sleep_for(utils::memory_governor::balance_period);
+  governor_.balance_if_due();
+  EXPECT_EQ(cold_.bytes_ + hot_.bytes_, 1000);
+}
@@ -0,0 +1,171 @@
+#include "rsafefs/config.hpp"
+#include "rsafefs/utils/memory_pressure.hpp"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace rsafefs;
+
+namespace
+{
+
+class fake_consumer : public utils::memory_consumer
+{
+public:
+  [[nodiscard]] size_t memory_usage() const override { return bytes_; }
+
+  [[nodiscard]] size_t memory_hits() const override { return 0; }
+
+  size_t shrink(size_t bytes) override
+  {
+    const size_t released = std::min(bytes, bytes_.load());
+    bytes_ -= released;
+    return released;
+  }
+
+  std::atomic<size_t> bytes_{1000};
+};
+
+// A cgroup directory written by the test instead of the kernel
+class MemoryPressureTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    char directory[] = "/tmp/memory_pressure_test_XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+    directory_ = directory;
+    write_cgroup("100", "1000", "0.00");
+    governor_.add("cache", &consumer_);
+  }
+
+  void TearDown() override
+  {
+    governor_.remove(&consumer_);
+    governor_.set_pressure_limit(0);
+    std::filesystem::remove_all(directory_);
+  }
+
+  void write_cgroup(const std::string &current, const std::string &max,
+                    const std::string &avg10)
+  {
+    std::ofstream(directory_ / "memory.current") << current << "\n";
+    std::ofstream(directory_ / "memory.max") << max << "\n";
+    std::ofstream(directory_ / "memory.pressure")
+        << "some avg10=" << avg10 << " avg60=0.00 avg300=0.00 total=0\n"
+        << "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+  }
+
+  utils::memory_pressure_monitor::config make_config(const std::string &yaml = "{}")
+  {
+    auto config = utils::memory_pressure_monitor::parse_config(YAML::Load(yaml));
+    config.cgroup_directory_ = directory_;
+    return config;
+  }
+
+  std::filesystem::path directory_;
+  utils::memory_governor &governor_ = utils::memory_governor::instance();
+  fake_consumer consumer_;
+};
+
+} // namespace
+
+TEST(MemoryPressureConfigTest, ValidConfig)
+{
+  const auto config = utils::memory_pressure_monitor::parse_config(
+      YAML::Load("{interval: 500, usage_threshold: 0.8, shrink_ratio: 0.25}"));
+  EXPECT_EQ(config.interval_.count(), 500);
+  EXPECT_DOUBLE_EQ(config.usage_threshold_, 0.8);
+  EXPECT_DOUBLE_EQ(config.shrink_ratio_, 0.25);
+}
+
+TEST(MemoryPressureConfigTest, WrongConfig)
+{
+  EXPECT_THROW(utils::memory_pressure_monitor::parse_config(YAML::Load("{interval: 0}")),
+               wrong_config_exception);
+  EXPECT_THROW(
+      utils::memory_pressure_monitor::parse_config(YAML::Load("{shrink_ratio: 2}")),
+      wrong_config_exception);
+  EXPECT_ANY_THROW(
+      utils::memory_pressure_monitor::parse_config(YAML::Load("{interval: string}")));
+}
+
+TEST_F(MemoryPressureTest, ReadsTheCgroup)
+{
+  write_cgroup("300", "max", "12.50");
+  utils::memory_pressure_monitor monitor(make_config(), governor_);
+  const auto sample = monitor.read_sample();
+  ASSERT_TRUE(sample);
+  EXPECT_EQ(sample->current_, 300);
+  EXPECT_FALSE(sample->max_);
+  EXPECT_DOUBLE_EQ(sample->pressure_, 12.5);
+}
+
+TEST_F(MemoryPressureTest, MissingCgroup)
+{
+  auto config = make_config();
+  config.cgroup_directory_ = directory_ / "missing";
+  utils::memory_pressure_monitor monitor(config, governor_);
+  EXPECT_FALSE(monitor.check());
+  EXPECT_EQ(consumer_.bytes_, 1000);
+}
+
+TEST_F(MemoryPressureTest, NoPressure)
+{
+  utils::memory_pressure_monitor monitor(make_config(), governor_);
+  EXPECT_TRUE(monitor.check());
+  EXPECT_EQ(consumer_.bytes_, 1000);
+  EXPECT_EQ(governor_.pressure_limit(), 0);
+}
+
+TEST_F(MemoryPressureTest, UsageNearTheLimitShrinksTheCaches)
+{
+  utils::memory_pressure_monitor monitor(make_config("{shrink_ratio: 0.2}"), governor_);
+  write_cgroup("950", "1000", "0.00");
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(consumer_.bytes_, 800);
+
+  // Every check under pressure gives back a bit more
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(consumer_.bytes_, 640);
+}
+
+TEST_F(MemoryPressureTest, StallsShrinkTheCaches)
+{
+  utils::memory_pressure_monitor monitor(make_config(), governor_);
+  write_cgroup("100", "max", "25.00");
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(consumer_.bytes_, 900);
+}
+
+TEST_F(MemoryPressureTest, CachesGrowBackWithoutPressure)
+{
+  utils::memory_pressure_monitor monitor(make_config("{shrink_ratio: 0.5}"), governor_);
+  write_cgroup("100", "max", "50.00");
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(governor_.pressure_limit(), 500);
+
+  write_cgroup("100", "max", "0.00");
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(governor_.pressure_limit(), 750);
+
+  // The cache is refilled up to the limit, which keeps growing until it is lifted
+  consumer_.bytes_ = 750;
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(governor_.pressure_limit(), 1125);
+  ASSERT_TRUE(monitor.check());
+  EXPECT_EQ(governor_.pressure_limit(), 0);
+}
+
+TEST_F(MemoryPressureTest, BackgroundThread)
+{
+  utils::memory_pressure_monitor monitor(make_config("{interval: 10}"), governor_);
+  write_cgroup("990", "1000", "0.00");
+  monitor.start();
+  for (int i = 0; i < 200 && consumer_.bytes_ == 1000; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  monitor.stop();
+  EXPECT_LT(consumer_.bytes_, 1000);
+  EXPECT_EQ(governor_.pressure_limit(), 0);
+}
@@ -1,5 +1,11 @@
+#include "rsafefs/config.hpp"
+#include "rsafefs/layers/metadata_cache/cache.hpp"
+#include "rsafefs/layers/metadata_cache/children_prefetcher.hpp"
 #include "rsafefs/layers/metadata_cache/metadata_cache.hpp"
+#include "rsafefs/utils/bulk_getattr.hpp"
+#include <atomic>
 #include <gtest/gtest.h>
+#include <thread>
 
 using namespace rsafefs;
 
@@ -23,6 +29,364 @@ TEST(MetadataCacheTest, WrongEvictionPolicy)
                metadata_cache_wrong_config_exception);
 }
 
+TEST(MetadataCacheTest, ArcEvictionPolicy)
+{
+  YAML::Node config = YAML::Load("{eviction_policy: arc}");
+  ASSERT_NO_THROW(std::make_unique<metadata_cache_config>(config));
+}
+
+TEST(MetadataCacheTest, SampledEvictionPolicy)
+{
+  YAML::Node config = YAML::Load("{eviction_policy: sampled}");
+  ASSERT_NO_THROW(std::make_unique<metadata_cache_config>(config));
+}
+
+TEST(MetadataCacheTest, TinyLfuAdmission)
+{
+  YAML::Node config = YAML::Load("{admission: tinylfu, eviction_policy: arc}");
+  ASSERT_NO_THROW(std::make_unique<metadata_cache_config>(config));
+}
+
+TEST(MetadataCacheTest, WrongAdmission)
+{
+  YAML::Node config = YAML::Load("{admission: lfu}");
+  ASSERT_THROW(std::make_unique<metadata_cache_config>(config),
+               metadata_cache_wrong_config_exception);
+}
+
+TEST(MetadataCacheTest, WrongShards)
+{
+  YAML::Node config = YAML::Load("{shards: 0}");
+  ASSERT_THROW(std::make_unique<metadata_cache_config>(config),
+               metadata_cache_wrong_config_exception);
+}
+
+TEST(MetadataCacheTest, ShardsServeConcurrentGets)
+{
+  metadata_cache::cache::config config{
+      .size_ = 1024,
+      .shards_ = 8,
+      .time_out_ = 0,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 0,
+      .negative_time_out_ = 0,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+  for (int i = 0; i < 256; i++) {
+    struct stat stbuf {
+    };
+    stbuf.st_size = i;
+    cache.put("/" + std::to_string(i), &stbuf);
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<int> wrong = 0;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 256; i++) {
+        struct stat stbuf {
+        };
+        if (!cache.get("/" + std::to_string(i), &stbuf) || stbuf.st_size != i) {
+          wrong++;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(wrong, 0);
+
+  // Shrinking takes entries from every shard until enough is freed
+  const size_t usage = cache.memory_usage();
+  EXPECT_GE(cache.shrink(usage / 2), usage / 2);
+  EXPECT_LE(cache.memory_usage(), usage - usage / 2);
+}
+
+TEST(MetadataCacheTest, LruEvictsLeastRecentlyUsed)
+{
+  metadata_cache::cache::config config{
+      .size_ = 2,
+      .shards_ = 1,
+      .time_out_ = 0,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 0,
+      .negative_time_out_ = 0,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+  struct stat stbuf {
+  };
+
+  cache.put("/a", &stbuf);
+  cache.put("/b", &stbuf);
+  ASSERT_TRUE(cache.get("/a", &stbuf));
+  cache.put("/c", &stbuf);
+
+  EXPECT_TRUE(cache.get("/a", &stbuf));
+  EXPECT_FALSE(cache.get("/b", &stbuf));
+  EXPECT_TRUE(cache.get("/c", &stbuf));
+
+  cache.remove("/a");
+  EXPECT_FALSE(cache.get("/a", &stbuf));
+  cache.put("/d", &stbuf);
+  EXPECT_TRUE(cache.get("/c", &stbuf));
+  EXPECT_TRUE(cache.get("/d", &stbuf));
+}
+
+TEST(MetadataCacheTest, PathRules)
+{
+  metadata_cache::cache::config config{
+      .size_ = 1,
+      .shards_ = 1,
+      .time_out_ = 60,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = utils::parse_path_rules(YAML::Load(R"(
+        - {path: /models, pin: true}
+        - {path: /checkpoints, bypass: true}
+        - {path: /scratch, time_out: 1}
+      )")),
+      .negative_size_ = 0,
+      .negative_time_out_ = 0,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+  struct stat stbuf {
+  };
+
+  // Pinned paths don't take the single slot of the cache
+  cache.put("/models/a", &stbuf);
+  cache.put("/models/b", &stbuf);
+  cache.put("/c", &stbuf);
+  cache.put("/d", &stbuf);
+  EXPECT_TRUE(cache.get("/models/a", &stbuf));
+  EXPECT_TRUE(cache.get("/models/b", &stbuf));
+  EXPECT_FALSE(cache.get("/c", &stbuf));
+  EXPECT_TRUE(cache.get("/d", &stbuf));
+  cache.remove("/models/a");
+  EXPECT_FALSE(cache.get("/models/a", &stbuf));
+
+  cache.put("/checkpoints/step_1", &stbuf);
+  EXPECT_FALSE(cache.get("/checkpoints/step_1", &stbuf));
+
+  cache.put("/scratch/file", &stbuf);
+  EXPECT_TRUE(cache.get("/scratch/file", &stbuf));
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  EXPECT_FALSE(cache.get("/scratch/file", &stbuf));
+}
+
+TEST(MetadataCacheTest, NegativeEntries)
+{
+  metadata_cache::cache::config config{
+      .size_ = 16,
+      .shards_ = 4,
+      .time_out_ = 60,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 2,
+      .negative_time_out_ = 1,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+
+  cache.put_negative("/missing");
+  EXPECT_TRUE(cache.get_negative("/missing"));
+  EXPECT_FALSE(cache.get_negative("/other"));
+  cache.remove("/missing");
+  EXPECT_FALSE(cache.get_negative("/missing"));
+
+  // Created after a getattr missed it, the attributes cached since are kept
+  struct stat stbuf {
+  };
+  stbuf.st_size = 3;
+  cache.put_negative("/created");
+  cache.put("/created", &stbuf);
+  cache.remove_negative("/created");
+  EXPECT_FALSE(cache.get_negative("/created"));
+  struct stat cached {
+  };
+  ASSERT_TRUE(cache.get("/created", &cached));
+  EXPECT_EQ(cached.st_size, 3);
+
+  // Entries under a directory are dropped when another one is moved there
+  cache.put_negative("/dir/a");
+  cache.put_negative("/dirx");
+  cache.remove_negatives_under("/dir");
+  EXPECT_FALSE(cache.get_negative("/dir/a"));
+  EXPECT_TRUE(cache.get_negative("/dirx"));
+
+  // They have their own time out
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  EXPECT_FALSE(cache.get_negative("/dirx"));
+}
+
+TEST(MetadataCacheTest, Listings)
+{
+  metadata_cache::cache::config config{
+      .size_ = 16,
+      .shards_ = 4,
+      .time_out_ = 60,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 0,
+      .negative_time_out_ = 0,
+      .dir_size_ = 8,
+      .readdir_plus_ = false,
+      .prefetch_children_ = false,
+  };
+  metadata_cache::cache cache(config);
+  const struct stat stbuf {
+  };
+
+  auto listing = std::make_shared<metadata_cache::cache::listing>();
+  listing->entries_.emplace_back("a", stbuf, 1);
+  listing->entries_.emplace_back("b", stbuf, 2);
+  cache.put_listing("/dir", listing);
+  const auto cached = cache.get_listing("/dir");
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->entries_.size(), 2);
+  EXPECT_EQ(cache.get_listing("/other"), nullptr);
+
+  // Dropped with the attributes of the directory
+  cache.remove("/dir");
+  EXPECT_EQ(cache.get_listing("/dir"), nullptr);
+
+  // Larger than the share of a shard, listings are kept apart from the shards
+  auto large = std::make_shared<metadata_cache::cache::listing>();
+  for (int i = 0; i < 5; i++) {
+    large->entries_.emplace_back(std::to_string(i), stbuf, i + 1);
+  }
+  cache.put_listing("/large", large);
+  ASSERT_NE(cache.get_listing("/large"), nullptr);
+  EXPECT_EQ(cache.get_listing("/large")->entries_.size(), 5);
+
+  // Larger than the cache
+  auto too_large = std::make_shared<metadata_cache::cache::listing>();
+  for (int i = 0; i < 8; i++) {
+    too_large->entries_.emplace_back(std::to_string(i), stbuf, i + 1);
+  }
+  cache.put_listing("/too_large", too_large);
+  EXPECT_EQ(cache.get_listing("/too_large"), nullptr);
+}
+
+TEST(MetadataCacheTest, PrefetchChildrenConfig)
+{
+  YAML::Node config = YAML::Load("{dir_size: 4096, prefetch_children: true}");
+  ASSERT_NO_THROW(std::make_unique<metadata_cache_config>(config));
+}
+
+TEST(MetadataCacheTest, ChildrenPrefetcher)
+{
+  metadata_cache::cache::config config{
+      .size_ = 4096,
+      .shards_ = 4,
+      .time_out_ = 60,
+      .eviction_policy_ = metadata_cache::cache::eviction_policy::lru,
+      .tinylfu_admission_ = false,
+      .warm_start_manifest_ = "",
+      .warm_start_rate_ = 1,
+      .rules_ = {},
+      .negative_size_ = 16,
+      .negative_time_out_ = 60,
+      .dir_size_ = 0,
+      .readdir_plus_ = false,
+      .prefetch_children_ = true,
+  };
+  metadata_cache::cache cache(config);
+
+  // Every child exists but /dir/missing. Once `hold` is set, a fetch waits for it to be
+  // cleared, so a mutation can overlap it
+  std::atomic<size_t> calls = 0;
+  std::atomic<bool> hold = false;
+  std::atomic<bool> fetching = false;
+  utils::bulk_getattr::instance().provide([&](const std::vector<std::string> &paths,
+                                              utils::bulk_getattr::attributes &found,
+                                              std::vector<std::string> &missing) {
+    calls++;
+    fetching = true;
+    while (hold) {
+      std::this_thread::yield();
+    }
+    for (const std::string &path : paths) {
+      if (path == "/dir/missing") {
+        missing.push_back(path);
+      } else {
+        struct stat stbuf {
+        };
+        stbuf.st_size = 1;
+        found.emplace_back(path, stbuf);
+      }
+    }
+    return 0;
+  });
+
+  metadata_cache::children_prefetcher prefetcher(cache);
+  struct stat stbuf {
+  };
+
+  // Batched by the prefetcher's thread, the missing children are cached as such
+  std::vector<std::string> names = {"missing"};
+  for (size_t i = 0; i < metadata_cache::children_prefetcher::batch; i++) {
+    names.push_back(std::to_string(i));
+  }
+  prefetcher.schedule("/dir", names);
+  prefetcher.drain();
+  EXPECT_EQ(calls, 2);
+  ASSERT_TRUE(cache.get("/dir/0", &stbuf));
+  EXPECT_EQ(stbuf.st_size, 1);
+  EXPECT_TRUE(cache.get_negative("/dir/missing"));
+
+  // A mutation under the directory while its children are fetched discards them, they
+  // may have been taken before it
+  hold = true;
+  fetching = false;
+  prefetcher.schedule("/other", {"a", "b"});
+  while (!fetching) {
+    std::this_thread::yield();
+  }
+  {
+    const metadata_cache::children_prefetcher::mutation mutation(&prefetcher, "/other/b");
+  }
+  hold = false;
+  prefetcher.drain();
+  EXPECT_FALSE(cache.get("/other/a", &stbuf));
+  EXPECT_FALSE(cache.get("/other/b", &stbuf));
+
+  utils::bulk_getattr::instance().withdraw();
+}
+
+TEST(MetadataCacheTest, WrongRules)
+{
+  YAML::Node config = YAML::Load("{rules: [{path: /models, pin: true, bypass: true}]}");
+  ASSERT_THROW(std::make_unique<metadata_cache_config>(config), wrong_config_exception);
+}
+
 TEST(MetadataCacheTest, WrongDataTypes)
 {
   YAML::Node config = YAML::Load("{size: string}");
@@ -53,6 +417,11 @@ TEST(MetadataCacheTest, InitLayerValid)
     return 0;
   };
 
+  bottom_operations.readdir = [](const char *, void *, fuse_fill_dir_t, off_t,
+                                 fuse_file_info *) {
+    return 0;
+  };
+
   bottom_operations.mknod = [](const char *, mode_t, dev_t) {
     return 0;
   };
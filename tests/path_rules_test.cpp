@@ -0,0 +1,95 @@
+#include "rsafefs/config.hpp"
+#include "rsafefs/utils/path_rules.hpp"
+#include <gtest/gtest.h>
+
+using namespace rsafefs;
+
+namespace
+{
+
+utils::path_rule
+make_rule(const std::string &pattern, int priority = 0)
+{
+  return {.pattern_ = pattern,
+          .time_out_ = {},
+          .pin_ = false,
+          .bypass_ = false,
+          .priority_ = priority};
+}
+
+} // namespace
+
+TEST(PathRulesTest, EmptyRulesMatchNothing)
+{
+  const utils::path_rules rules;
+  EXPECT_TRUE(rules.empty());
+  EXPECT_EQ(rules.match("/any/path"), nullptr);
+}
+
+TEST(PathRulesTest, PrefixesMatchWholeComponents)
+{
+  const utils::path_rules rules({make_rule("/models")});
+  EXPECT_NE(rules.match("/models"), nullptr);
+  EXPECT_NE(rules.match("/models/"), nullptr);
+  EXPECT_NE(rules.match("/models/llama/weights.bin"), nullptr);
+  EXPECT_EQ(rules.match("/modelsX/weights.bin"), nullptr);
+  EXPECT_EQ(rules.match("/"), nullptr);
+}
+
+TEST(PathRulesTest, LongestPrefixWinsAmongEqualPriorities)
+{
+  const utils::path_rules rules({make_rule("/"), make_rule("/data/scratch"),
+                                 make_rule("/data")});
+  EXPECT_EQ(rules.match("/home/file")->pattern_, "/");
+  EXPECT_EQ(rules.match("/data/file")->pattern_, "/data");
+  EXPECT_EQ(rules.match("/data/scratch/file")->pattern_, "/data/scratch");
+}
+
+TEST(PathRulesTest, HigherPriorityWinsOverLongerPrefix)
+{
+  const utils::path_rules rules({make_rule("/data", 10), make_rule("/data/scratch")});
+  EXPECT_EQ(rules.match("/data/scratch/file")->pattern_, "/data");
+}
+
+TEST(PathRulesTest, GlobsMatchTheWholePath)
+{
+  const utils::path_rules rules({make_rule("/checkpoints/*.ckpt"), make_rule("/*.tmp")});
+  EXPECT_EQ(rules.match("/checkpoints/step_100.ckpt")->pattern_, "/checkpoints/*.ckpt");
+  EXPECT_EQ(rules.match("/checkpoints/run/step_100.ckpt")->pattern_,
+            "/checkpoints/*.ckpt");
+  EXPECT_EQ(rules.match("/checkpoints/step_100.json"), nullptr);
+  EXPECT_EQ(rules.match("/home/user/file.tmp")->pattern_, "/*.tmp");
+}
+
+TEST(PathRulesTest, ParseRules)
+{
+  const YAML::Node data = YAML::Load(R"(
+    - path: /checkpoints
+      bypass: true
+    - path: /models
+      pin: true
+      priority: 10
+    - path: /scratch/*
+      time_out: 1
+  )");
+  const std::vector<utils::path_rule> rules = utils::parse_path_rules(data);
+  ASSERT_EQ(rules.size(), 3);
+  EXPECT_TRUE(rules[0].bypass_);
+  EXPECT_FALSE(rules[0].time_out_);
+  EXPECT_TRUE(rules[1].pin_);
+  EXPECT_EQ(rules[1].priority_, 10);
+  EXPECT_EQ(rules[2].time_out_, 1);
+  EXPECT_EQ(rules[2].priority_, 0);
+}
+
+TEST(PathRulesTest, WrongRules)
+{
+  EXPECT_THROW(utils::parse_path_rules(YAML::Load("path: /models")),
+               wrong_config_exception);
+  EXPECT_THROW(utils::parse_path_rules(YAML::Load("[{path: models}]")),
+               wrong_config_exception);
+  EXPECT_THROW(utils::parse_path_rules(YAML::Load("[{path: /m, pin: true, bypass: true}]")),
+               wrong_config_exception);
+  EXPECT_THROW(utils::parse_path_rules(YAML::Load("[{path: /m, time_out: -1}]")),
+               wrong_config_exception);
+}
@@ -0,0 +1,147 @@
+#include "rsafefs/utils/warm_start.hpp"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace rsafefs;
+
+namespace
+{
+
+class WarmStartTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    char directory[] = "/tmp/warm_start_test_XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+    directory_ = directory;
+    manifest_ = directory_ / "manifest";
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  static utils::manifest_entry
+  make_entry(const std::string &path, std::vector<uint64_t> blocks)
+  {
+    utils::manifest_entry entry{};
+    entry.path_ = path;
+    entry.mtime_.tv_sec = 1700000000;
+    entry.mtime_.tv_nsec = 123456789;
+    entry.size_ = 4096;
+    entry.blocks_ = std::move(blocks);
+    return entry;
+  }
+
+  std::filesystem::path directory_;
+  std::string manifest_;
+};
+
+} // namespace
+
+TEST_F(WarmStartTest, ManifestRoundTrip)
+{
+  const std::vector<utils::manifest_entry> entries{
+      make_entry("/hot", {3, 1, 2}),
+      make_entry("/warm", {}),
+  };
+  ASSERT_TRUE(utils::save_manifest(manifest_, entries));
+  EXPECT_FALSE(std::filesystem::exists(manifest_ + ".tmp"));
+
+  const std::vector<utils::manifest_entry> loaded = utils::load_manifest(manifest_);
+  ASSERT_EQ(loaded.size(), 2);
+  EXPECT_EQ(loaded[0].path_, "/hot");
+  EXPECT_EQ(loaded[0].blocks_, std::vector<uint64_t>({3, 1, 2}));
+  EXPECT_EQ(loaded[0].mtime_.tv_sec, 1700000000);
+  EXPECT_EQ(loaded[0].mtime_.tv_nsec, 123456789);
+  EXPECT_EQ(loaded[0].size_, 4096);
+  EXPECT_EQ(loaded[1].path_, "/warm");
+  EXPECT_TRUE(loaded[1].blocks_.empty());
+}
+
+TEST_F(WarmStartTest, MissingOrInvalidManifestIsEmpty)
+{
+  EXPECT_TRUE(utils::load_manifest(manifest_).empty());
+
+  std::ofstream(manifest_) << "not a manifest";
+  EXPECT_TRUE(utils::load_manifest(manifest_).empty());
+}
+
+TEST_F(WarmStartTest, TruncatedManifestKeepsTheCompleteEntries)
+{
+  ASSERT_TRUE(
+      utils::save_manifest(manifest_, {make_entry("/a", {1}), make_entry("/b", {2})}));
+  std::filesystem::resize_file(manifest_, std::filesystem::file_size(manifest_) - 4);
+
+  const std::vector<utils::manifest_entry> loaded = utils::load_manifest(manifest_);
+  ASSERT_EQ(loaded.size(), 1);
+  EXPECT_EQ(loaded[0].path_, "/a");
+}
+
+TEST_F(WarmStartTest, UnchangedComparesMtimeAndSize)
+{
+  const utils::manifest_entry entry = make_entry("/file", {});
+  struct stat stbuf {
+  };
+  stbuf.st_size = entry.size_;
+#ifdef __APPLE__
+  stbuf.st_mtimespec = entry.mtime_;
+#else
+  stbuf.st_mtim = entry.mtime_;
+#endif
+  EXPECT_TRUE(utils::is_unchanged(entry, stbuf));
+
+  stbuf.st_size++;
+  EXPECT_FALSE(utils::is_unchanged(entry, stbuf));
+}
+
+TEST_F(WarmStartTest, PrefetcherReplaysEveryEntryAtTheRate)
+{
+  std::vector<utils::manifest_entry> entries;
+  for (int i = 0; i < 10; i++) {
+    entries.push_back(make_entry("/" + std::to_string(i), {}));
+  }
+  std::vector<std::string> replayed;
+  utils::warm_start_prefetcher prefetcher(
+      entries, 100,
+      [&](const utils::manifest_entry &entry, utils::warm_start_prefetcher &prefetcher) {
+        if (prefetcher.pace()) {
+          replayed.push_back(entry.path_);
+        }
+      });
+
+  const auto start = std::chrono::steady_clock::now();
+  prefetcher.start();
+  prefetcher.join();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_EQ(replayed.size(), 10);
+  EXPECT_EQ(replayed.front(), "/0");
+  EXPECT_EQ(prefetcher.paced(), 10);
+  // 10 fetches at 100 a second
+  EXPECT_GE(elapsed, std::chrono::milliseconds(90));
+}
+
+TEST_F(WarmStartTest, StopInterruptsTheReplay)
+{
+  std::vector<utils::manifest_entry> entries;
+  for (int i = 0; i < 100; i++) {
+    entries.push_back(make_entry("/" + std::to_string(i), {}));
+  }
+  std::atomic<size_t> n_replayed = 0;
+  utils::warm_start_prefetcher prefetcher(
+      entries, 10,
+      [&](const utils::manifest_entry &, utils::warm_start_prefetcher &prefetcher) {
+        if (prefetcher.pace()) {
+          n_replayed++;
+        }
+      });
+
+  prefetcher.start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  prefetcher.stop();
+
+  EXPECT_GE(n_replayed, 1);
+  EXPECT_LT(n_replayed, 100);
+}